@@ -0,0 +1,91 @@
+#ifndef MPX_CORO_H
+#define MPX_CORO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ @file coro.h
+ @brief Coroutines inside one process, switched without entering the kernel
+*/
+
+/** Stack size coro_create() uses when given 0 */
+#define CORO_STACK_DEFAULT 512
+
+/** Smallest stack coro_create() accepts */
+#define CORO_STACK_MIN 128
+
+/** Value kept in the lowest word of each coroutine stack to catch overflow */
+#define CORO_CANARY 0xC0DEC0DE
+
+/** A coroutine. Only the scheduler touches its fields. */
+struct coro {
+	uint32_t esp;			/** saved stack pointer while switched out */
+	struct coro *next;		/** run queue, wait list or free list */
+	int (*ready)(void *);		/** non-NULL while waiting */
+	void *ready_arg;
+	void (*fn)(void *);
+	void *arg;
+	uint32_t *stack;		/** lowest word holds CORO_CANARY */
+	size_t stack_size;
+};
+
+/** A set of coroutines run by one coro_run() loop */
+struct coro_sched {
+	struct coro *run_head;		/** runnable, in order */
+	struct coro *run_tail;
+	struct coro *waiting;		/** parked in coro_wait() */
+	struct coro *free;		/** finished, kept with their stacks */
+	struct coro *current;		/** running, NULL in the scheduler */
+	uint32_t esp;			/** scheduler's stack pointer while one runs */
+	unsigned int live;		/** created and not yet finished */
+};
+
+/**
+ Prepares an empty scheduler.
+ @param s The scheduler to initialize
+*/
+void coro_sched_init(struct coro_sched *s);
+
+/**
+ Creates a runnable coroutine. Its stack comes from sys_alloc_mem(), or from
+ a finished coroutine of the same scheduler when one is big enough.
+ @param s The scheduler to add it to
+ @param fn The function the coroutine runs; returning finishes it
+ @param arg The argument for fn
+ @param stack_size Bytes of stack, or 0 for CORO_STACK_DEFAULT
+ @return The coroutine, or NULL if no memory was available
+*/
+struct coro *coro_create(struct coro_sched *s, void (*fn)(void *), void *arg, size_t stack_size);
+
+/**
+ Lets the other runnable coroutines run, then continues. Called from a coroutine.
+ @param s The scheduler running the coroutine
+*/
+void coro_yield(struct coro_sched *s);
+
+/**
+ Parks the running coroutine until ready(arg) returns non-zero. The
+ scheduler polls it each round. Called from a coroutine.
+ @param s The scheduler running the coroutine
+ @param ready The condition to wait for
+ @param arg The argument for ready
+*/
+void coro_wait(struct coro_sched *s, int (*ready)(void *), void *arg);
+
+/**
+ Runs coroutines until all have finished. When every coroutine is waiting,
+ the process gives up the CPU with an IDLE request before polling again.
+ @param s The scheduler to run
+*/
+void coro_run(struct coro_sched *s);
+
+/**
+ Saves callee-saved registers and the stack pointer, and resumes the
+ context saved at new_esp. Defined in coro-asm.s.
+ @param save_esp Receives the stack pointer to resume this context with
+ @param new_esp The stack pointer of the context to resume
+*/
+void coro_switch(uint32_t *save_esp, uint32_t new_esp);
+
+#endif
@@ -2,6 +2,8 @@
 #define MPX_MEMORY_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <mpx/device.h>
 
 /**
  @file memory.h
@@ -29,4 +31,41 @@ int sys_free_mem(void *ptr);
 */
 void sys_set_heap_functions(void * (*alloc_fn)(size_t), int (*free_fn)(void *));
 
+/** Number of heap operations the allocation trace holds before wrapping */
+#define ALLOC_TRACE_SIZE 1024
+
+/** Operations recorded in the allocation trace */
+#define ALLOC_TRACE_ALLOC 'A'
+#define ALLOC_TRACE_FREE 'F'
+
+/** One heap operation */
+struct alloc_trace_entry {
+	uint32_t timestamp;	/** low half of the time stamp counter */
+	uint32_t size;		/** bytes asked for, 0 for a free */
+	uint32_t ptr;		/** address returned or freed; identifies the block */
+	char op;		/** ALLOC_TRACE_ALLOC or ALLOC_TRACE_FREE */
+};
+
+/**
+ Starts or stops recording sys_alloc_mem() and sys_free_mem() calls. Starting
+ discards anything already recorded.
+ @param enable Non-zero to record, 0 to stop
+*/
+void sys_alloc_trace(int enable);
+
+/**
+ Copies the recorded operations out, oldest first.
+ @param out Where to put them
+ @param max The most entries out can hold
+ @return The number of entries copied
+*/
+unsigned int sys_alloc_trace_copy(struct alloc_trace_entry *out, unsigned int max);
+
+/**
+ Writes the recorded operations to a console, oldest first, one per line
+ as "op timestamp size ptr" in hex, for tools/alloc-replay.
+ @param dev The console to write to
+*/
+void sys_alloc_trace_dump(device dev);
+
 #endif
@@ -0,0 +1,70 @@
+#ifndef MPX_ARENA_H
+#define MPX_ARENA_H
+
+#include <stddef.h>
+
+/**
+ @file mpx/arena.h
+ @brief Per-process memory arenas, released wholesale when a process is freed
+*/
+
+/** Usable bytes in a standard arena chunk */
+#define ARENA_CHUNK_SIZE 1024
+
+struct arena_chunk;
+
+/** The memory owned by a single process */
+struct arena {
+	struct arena_chunk *chunks;	/** standard chunks, newest first */
+	struct arena_chunk *tail;	/** oldest standard chunk */
+	struct arena_chunk *large;	/** oversized chunks, newest first */
+	struct arena_chunk *large_tail;	/** oldest oversized chunk */
+	size_t used;			/** bytes handed out from this arena */
+	size_t reserved;		/** bytes held in this arena's chunks */
+};
+
+/**
+ Prepares an empty arena.
+ @param a The arena to initialize
+*/
+void arena_init(struct arena *a);
+
+/**
+ Carves memory out of an arena, growing it by one chunk if necessary.
+ @param a The arena to allocate from
+ @param size The amount of memory, in bytes, to allocate
+ @return NULL on error, otherwise the address of the newly allocated memory
+*/
+void *arena_alloc(struct arena *a, size_t size);
+
+/**
+ Gives memory back to an arena. An oversized allocation returns its chunk to
+ the free list; a standard one is reclaimed only if it is the newest.
+ @param a The arena ptr came from
+ @param ptr The address of memory from arena_alloc()
+*/
+void arena_free(struct arena *a, void *ptr);
+
+/**
+ Returns every chunk held by an arena to the free chunk lists in one step.
+ @param a The arena to release
+*/
+void arena_release(struct arena *a);
+
+/**
+ Heap allocation function for sys_set_heap_functions(). Allocates from the
+ arena of the running process, or from the kernel heap if none is running.
+ @param size The amount of memory, in bytes, to allocate
+ @return NULL on error, otherwise the address of the newly allocated memory
+*/
+void *arena_heap_alloc(size_t size);
+
+/**
+ Heap free function for sys_set_heap_functions(). Frees with arena_free();
+ what it can't reclaim returns when the owning arena is released.
+ @param ptr The address of dynamically allocated memory
+ @return 0 on success, non-zero on error
+*/
+int arena_heap_free(void *ptr);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef MPX_ATA_H
+#define MPX_ATA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ @file mpx/ata.h
+ @brief PIO driver for the master disk on the primary IDE channel
+*/
+
+/** Bytes in a sector, the unit the disk is read and written in */
+#define ATA_SECTOR_SIZE 512
+
+/** Most sectors one command moves */
+#define ATA_MAX_SECTORS 256
+
+/** What IDENTIFY DEVICE reported about the disk */
+struct ata_info {
+	uint32_t sectors;	/** sectors addressable with 28-bit LBA */
+	char model[41];		/** model string, NUL-terminated */
+};
+
+/**
+ Looks for an ATA disk on the primary master with IDENTIFY DEVICE and
+ leaves its interrupt off; the driver polls. A QEMU -hda image appears here.
+ @return 0 if a disk was found, non-zero if not
+*/
+int ata_init(void);
+
+/**
+ Reports what ata_init() found.
+ @param info Filled in with the disk's size and model
+ @return 0 on success, non-zero if there is no disk
+*/
+int ata_get_info(struct ata_info *info);
+
+/**
+ Reads consecutive sectors with a single READ SECTORS command.
+ @param lba The first sector
+ @param count The number of sectors, 1 to ATA_MAX_SECTORS
+ @param buffer Where to put count * ATA_SECTOR_SIZE bytes
+ @return 0 on success, -1 if there is no disk or the range is outside it,
+         -2 if the disk reported an error
+*/
+int ata_read(uint32_t lba, unsigned int count, void *buffer);
+
+/**
+ Writes consecutive sectors with a single WRITE SECTORS command.
+ @param lba The first sector
+ @param count The number of sectors, 1 to ATA_MAX_SECTORS
+ @param buffer The count * ATA_SECTOR_SIZE bytes to write
+ @return 0 on success, -1 if there is no disk or the range is outside it,
+         -2 if the disk reported an error
+*/
+int ata_write(uint32_t lba, unsigned int count, const void *buffer);
+
+/**
+ Has the disk commit its own write cache to the medium.
+ @return 0 on success, -1 if there is no disk, -2 on error
+*/
+int ata_flush(void);
+
+#endif
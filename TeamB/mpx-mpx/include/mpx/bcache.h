@@ -0,0 +1,72 @@
+#ifndef MPX_BCACHE_H
+#define MPX_BCACHE_H
+
+#include <stdint.h>
+#include <mpx/ata.h>
+
+/**
+ @file mpx/bcache.h
+ @brief Write-back LRU cache of disk blocks with sequential read-ahead
+*/
+
+/** Bytes in a block; one disk sector */
+#define BCACHE_BLOCK_SIZE ATA_SECTOR_SIZE
+
+/** Blocks the cache holds */
+#define BCACHE_BLOCKS 64
+
+/** Blocks fetched past a miss, in the same disk command, once reads go in order */
+#define BCACHE_READAHEAD 8
+
+/** Counters kept since bcache_init() */
+struct bcache_stats {
+	uint32_t hits;		/** reads and writes served from the cache */
+	uint32_t misses;	/** reads and writes that had to take a buffer */
+	uint32_t disk_reads;	/** READ SECTORS commands issued */
+	uint32_t readahead;	/** blocks fetched before they were asked for */
+	uint32_t readahead_hits;	/** of those, the ones later read */
+	uint32_t writebacks;	/** dirty blocks written to the disk */
+	uint32_t dirty;		/** blocks waiting to be written */
+};
+
+/**
+ Allocates the cache buffers. Call after vm_init() and ata_init().
+ @return 0 on success, non-zero if there is no disk or no memory
+*/
+int bcache_init(void);
+
+/**
+ Copies a block out of the cache, reading it from the disk on a miss.
+ A miss right after the previous block was read also fetches the next
+ BCACHE_READAHEAD blocks.
+ @param block The block number
+ @param buffer Where to put BCACHE_BLOCK_SIZE bytes
+ @return 0 on success, -1 if the cache is not set up or the block is
+         outside the disk, -2 on a disk error
+*/
+int bcache_read(uint32_t block, void *buffer);
+
+/**
+ Replaces a block in the cache. It reaches the disk when it is evicted or
+ at bcache_sync(), so repeated writes to a block cost one disk write.
+ @param block The block number
+ @param buffer The BCACHE_BLOCK_SIZE bytes to write
+ @return 0 on success, -1 if the cache is not set up or the block is
+         outside the disk, -2 if writing back an evicted block failed
+*/
+int bcache_write(uint32_t block, const void *buffer);
+
+/**
+ Writes every dirty block to the disk, runs of consecutive blocks in one
+ command, and has the disk flush its own cache.
+ @return 0 on success, -1 if the cache is not set up, -2 on a disk error
+*/
+int bcache_sync(void);
+
+/**
+ Reports the cache counters.
+ @param stats Filled in with the counters
+*/
+void bcache_get_stats(struct bcache_stats *stats);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef MPX_DCB_H
+#define MPX_DCB_H
+
+#include <stddef.h>
+#include <mpx/device.h>
+#include <mpx/serial.h>
+#include <sys_req.h>
+
+/**
+ @file mpx/dcb.h
+ @brief Device control blocks and the queues of READ and WRITE requests
+*/
+
+/** io_request() result for a request left queued; the caller must block */
+#define IO_PENDING	(-4)
+
+struct pcb;
+
+/** One READ or WRITE request. Each PCB has one, as a requester blocks. */
+struct iocb {
+	struct pcb *pcb;	/** the process that asked */
+	op_code op;		/** READ or WRITE */
+	char *buffer;
+	size_t len;
+	size_t done;		/** bytes of a WRITE handed to the device */
+	int queued;		/** non-zero until the request completes */
+	struct iocb *next;
+};
+
+/** Requests waiting on one direction of a device, served in order */
+struct iocb_queue {
+	struct iocb *head;	/** the request being worked on */
+	struct iocb *tail;
+};
+
+/** A device opened for kernel-managed I/O */
+struct dcb {
+	device dev;
+	int open;
+	struct iocb_queue reads;
+	struct iocb_queue writes;	/** kept apart so output flows during a READ */
+	struct serial_line line;	/** the line the head READ is editing */
+};
+
+/**
+ Switches a serial port to interrupt-driven I/O, or clears the screen and
+ starts the keyboard for CONSOLE, and lets processes READ and WRITE it
+ through the kernel.
+ @param dev The serial port, already initialized, or CONSOLE
+ @return 0 on success, non-zero on error
+*/
+int io_open(device dev);
+
+/**
+ Queues a READ or WRITE for a process and starts it if the device is free.
+ @param pcb The requesting process
+ @param op READ or WRITE
+ @param dev The device
+ @param buffer The bytes to write, or where to put the line read
+ @param len The bytes to write, or the size of buffer
+ @return The byte count if the request completed at once, IO_PENDING if it
+         was queued, INVALID_BUFFER, or -1 if the device is not open
+*/
+int io_request(struct pcb *pcb, op_code op, device dev, char *buffer, size_t len);
+
+/**
+ Moves the queued requests along and readies the processes whose requests
+ completed, storing the byte count as their sys_req() result. Called by
+ sys_call() on every dispatch; interrupts must be off.
+*/
+void io_schedule(void);
+
+/**
+ Drops a process's request from its queue, e.g. when it is deleted.
+ @param pcb The process
+*/
+void io_cancel(struct pcb *pcb);
+
+/**
+ Lowest-priority process that writes out the kernel log, then halts until
+ a device interrupt may have finished a request, instead of spinning
+ through IDLE.
+*/
+void io_idle_process(void);
+
+#endif
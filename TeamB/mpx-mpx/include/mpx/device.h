@@ -6,6 +6,7 @@ typedef enum {
 	COM2 = 0x2f8,
 	COM3 = 0x3e8,
 	COM4 = 0x2e8,
+	CONSOLE = 0xb8000,	// the VGA screen and PS/2 keyboard, not a port
 } device;
 
 #endif
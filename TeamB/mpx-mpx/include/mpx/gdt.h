@@ -6,7 +6,23 @@
  @brief Kernel functions to initialize the Global Descriptor Table
 */
 
+#include <stddef.h>
+
+/** Selector of the TSS the kernel runs in */
+#define GDT_KERNEL_TSS	0x28
+
+/** Selector of the TSS that services page faults */
+#define GDT_PAGE_FAULT_TSS	0x30
+
 /** Creates and installs the Global Descriptor Table. */
 void gdt_init(void);
 
+/**
+ Fills in the descriptor for a Task State Segment.
+ @param selector GDT_KERNEL_TSS or GDT_PAGE_FAULT_TSS
+ @param tss The Task State Segment
+ @param size The size of the Task State Segment in bytes
+*/
+void gdt_install_tss(int selector, void *tss, size_t size);
+
 #endif
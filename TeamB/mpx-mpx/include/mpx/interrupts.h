@@ -1,6 +1,8 @@
 #ifndef MPX_INTERRUPTS_H
 #define MPX_INTERRUPTS_H
 
+#include <stdint.h>
+
 /**
  @file mpx/interrupts.h
  @brief Kernel functions related to software and hardware interrupts
@@ -30,4 +32,12 @@ void idt_init(void);
 /** Installs an interrupt handler */
 void idt_install(int vector, void (*handler)(void *));
 
+/**
+ Installs a task gate, so the interrupt is serviced by a hardware task switch
+ onto the stack held in that task's TSS.
+ @param vector The interrupt vector
+ @param tss_selector GDT selector of the handling task's TSS
+*/
+void idt_install_task_gate(int vector, uint16_t tss_selector);
+
 #endif
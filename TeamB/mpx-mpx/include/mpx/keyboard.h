@@ -0,0 +1,41 @@
+#ifndef MPX_KEYBOARD_H
+#define MPX_KEYBOARD_H
+
+#include <stddef.h>
+
+/**
+ @file mpx/keyboard.h
+ @brief PS/2 keyboard driven by IRQ 1
+*/
+
+/** Bytes of typed-ahead input kept until read; a power of two */
+#define KEYBOARD_RING_SIZE 128
+
+/**
+ Installs the IRQ 1 handler and unmasks it. Keys are turned into the bytes
+ a serial terminal would send: Enter is a carriage return, Backspace is
+ DEL, and the arrow and Delete keys are ANSI escape sequences.
+ @return 0 on success
+*/
+int keyboard_init(void);
+
+/**
+ Takes typed bytes from the ring without waiting.
+ @param buffer Where to put the bytes
+ @param len The most bytes to take
+ @return The number of bytes taken, possibly 0
+*/
+int keyboard_read(char *buffer, size_t len);
+
+/**
+ Checks whether a key was typed since the last keyboard_event_clear().
+ @return Non-zero if one was
+*/
+int keyboard_event_pending(void);
+
+/**
+ Clears the flag read by keyboard_event_pending().
+*/
+void keyboard_event_clear(void);
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef MPX_KLOG_H
+#define MPX_KLOG_H
+
+#include <stdint.h>
+
+/**
+ @file mpx/klog.h
+ @brief Kernel log kept in a ring and written to COM1 when the system idles
+*/
+
+/** Severity levels, most severe first */
+#define KLOG_ERR	0
+#define KLOG_WARN	1
+#define KLOG_INFO	2
+#define KLOG_DEBUG	3
+
+/** Messages the ring holds before the oldest are overwritten */
+#define KLOG_ENTRIES	128
+
+/** Longest subsystem tag */
+#define KLOG_TAG_LEN	7
+
+/** Longest message, including the NUL; longer ones are cut short */
+#define KLOG_MSG_LEN	96
+
+/** One logged message */
+struct klog_entry {
+	uint64_t timestamp;	/** time stamp counter when it was logged */
+	uint32_t seq;		/** messages logged before this one */
+	uint8_t level;
+	char tag[KLOG_TAG_LEN + 1];
+	char msg[KLOG_MSG_LEN];
+};
+
+/**
+ Appends a message to the log. Only formats into the ring, so it is cheap
+ enough for hot paths and safe in interrupt handlers.
+ @param level KLOG_ERR to KLOG_DEBUG
+ @param tag The subsystem logging it, e.g. "serial"
+ @param fmt A printf() format
+*/
+void klog(int level, const char *tag, const char *fmt, ...)
+	__attribute__((format(printf, 3, 4)));
+
+/**
+ Writes messages not yet shown, at or above the console level, to COM1
+ for as long as its transmit ring has room. Called by the idle process.
+*/
+void klog_flush(void);
+
+/**
+ Writes every message not yet shown to COM1, waiting for the line as
+ needed. For boot, shutdown and panics.
+*/
+void klog_drain(void);
+
+/**
+ Sets the least severe level written to the console. Every level is
+ still kept in the ring for dmesg.
+ @param level KLOG_ERR to KLOG_DEBUG
+ @return 0 on success, non-zero if level is out of range
+*/
+int klog_set_level(int level);
+
+/**
+ Gets the least severe level written to the console.
+ @return KLOG_ERR to KLOG_DEBUG
+*/
+int klog_get_level(void);
+
+/**
+ Copies the next message still in the ring.
+ @param cursor 0 to start from the oldest; advanced past the message copied
+ @param entry Filled in with the message
+ @return Non-zero if a message was copied, 0 at the end of the log
+*/
+int klog_read(uint32_t *cursor, struct klog_entry *entry);
+
+/**
+ Names a level.
+ @param level KLOG_ERR to KLOG_DEBUG
+ @return "ERR", "WARN", "INFO" or "DEBUG"
+*/
+const char *klog_level_name(int level);
+
+#endif
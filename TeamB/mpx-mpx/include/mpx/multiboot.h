@@ -0,0 +1,45 @@
+#ifndef MPX_MULTIBOOT_H
+#define MPX_MULTIBOOT_H
+
+#include <stdint.h>
+
+/**
+ @file mpx/multiboot.h
+ @brief Boot information handed to the kernel by a Multiboot loader
+*/
+
+/** Value left in EAX by a Multiboot-compliant loader */
+#define MULTIBOOT_BOOTLOADER_MAGIC	0x2BADB002
+
+/** mem_lower and mem_upper are valid */
+#define MULTIBOOT_INFO_MEMORY		(1 << 0)
+
+/** mmap_length and mmap_addr are valid */
+#define MULTIBOOT_INFO_MEM_MAP		(1 << 6)
+
+/** Memory map entry type for RAM available to the OS */
+#define MULTIBOOT_MEMORY_AVAILABLE	1
+
+/** The leading fields of the Multiboot information structure */
+struct multiboot_info {
+	uint32_t flags;
+	uint32_t mem_lower;	/** KB of memory below 1 MB */
+	uint32_t mem_upper;	/** KB of memory above 1 MB */
+	uint32_t boot_device;
+	uint32_t cmdline;
+	uint32_t mods_count;
+	uint32_t mods_addr;
+	uint32_t syms[4];
+	uint32_t mmap_length;	/** size of the memory map in bytes */
+	uint32_t mmap_addr;	/** physical address of the memory map */
+} __attribute__((packed));
+
+/** A single entry in the Multiboot memory map */
+struct multiboot_mmap_entry {
+	uint32_t size;		/** size of the rest of the entry */
+	uint64_t addr;
+	uint64_t len;
+	uint32_t type;
+} __attribute__((packed));
+
+#endif
@@ -2,6 +2,7 @@
 #define MPX_SERIAL_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <mpx/device.h>
 
 /**
@@ -9,6 +10,27 @@
  @brief Kernel functions and constants for handling serial I/O
 */
 
+/** Fastest line rate; the UART clock divided by the smallest divisor */
+#define SERIAL_MAX_BAUD 115200
+
+/** Line rate ports start at */
+#define SERIAL_DEFAULT_BAUD 9600
+
+/** Line settings of a port. Framing is always 8N1. */
+struct serial_config {
+	uint32_t baud;		/** a divisor of SERIAL_MAX_BAUD */
+	unsigned int fifo_trigger;	/** receive FIFO level that interrupts: 1, 4, 8 or 14 */
+	int flow_control;	/** non-zero for RTS/CTS */
+};
+
+/**
+ Checks for a UART at a port's address by writing and reading back its
+ scratch register.
+ @param dev The serial port
+ @return Non-zero if a UART answered
+*/
+int serial_detect(device dev);
+
 /**
  Initializes devices for user input and output
  @param device A serial port to initialize (COM1, COM2, COM3, or COM4)
@@ -16,6 +38,133 @@
 */
 int serial_init(device dev);
 
+/** Bytes held by each receive and transmit ring; a power of two */
+#define SERIAL_RING_SIZE 256
+
+/** Transmit FIFO depth of a 16550A; older UARTs take one byte at a time */
+#define SERIAL_FIFO_DEPTH 16
+
+/** Transmit counters for a port, kept since serial_init() */
+struct serial_stats {
+	uint32_t bytes_sent;	/** bytes written to the THR */
+	uint32_t fifo_refills;	/** times an empty transmitter was refilled */
+	uint64_t stall_cycles;	/** TSC cycles spent waiting for the transmitter */
+	unsigned int fifo_depth;	/** bytes written per refill */
+};
+
+/**
+ Switches an initialized port to interrupt-driven I/O. Received bytes are
+ kept in a ring until read, and serial_out() queues bytes for the THR-empty
+ interrupt to send instead of writing the port itself.
+ @param dev The serial port
+ @return 0 on success, non-zero if the port is not initialized
+*/
+int serial_irq_init(device dev);
+
+/**
+ Takes received bytes from a port's ring without waiting.
+ @param dev A port set up with serial_irq_init()
+ @param buffer Where to put the bytes
+ @param len The most bytes to take
+ @return The number of bytes taken, possibly 0, or -1 if the port is not interrupt-driven
+*/
+int serial_read(device dev, char *buffer, size_t len);
+
+/**
+ Queues bytes for transmission without waiting.
+ @param dev A port set up with serial_irq_init()
+ @param buffer The bytes to send
+ @param len The number of bytes to send
+ @return The number of bytes queued, which is less than len if the ring filled,
+         or -1 if the port is not interrupt-driven
+*/
+int serial_write(device dev, const char *buffer, size_t len);
+
+/**
+ Reports how many bytes serial_write() would take without waiting.
+ @param dev A port set up with serial_irq_init()
+ @return Free space in the transmit ring, or -1 if the port is not interrupt-driven
+*/
+int serial_tx_room(device dev);
+
+/**
+ Checks whether the IRQ handler received or sent anything on any port since
+ the last serial_event_clear().
+ @return Non-zero if something happened
+*/
+int serial_event_pending(void);
+
+/**
+ Clears the flag read by serial_event_pending().
+*/
+void serial_event_clear(void);
+
+/** Lines each port, and the screen console, remembers for Up and Down */
+#define SERIAL_HISTORY_SIZE 16
+
+/** Longest line kept in the history, including the NUL */
+#define SERIAL_HISTORY_LINE 100
+
+/** State of a line being read and echoed a byte at a time */
+struct serial_line {
+	char *buffer;		/** where the line is collected */
+	size_t len;		/** size of buffer, including the NUL */
+	size_t count;		/** bytes in the line so far */
+	size_t cursor;		/** position of the cursor in the line */
+	int escape;		/** bytes of an escape sequence seen so far */
+	char escape1;		/** the byte after ESC */
+	unsigned int recall;	/** history entries back from the newest, 0 if none */
+};
+
+/**
+ Starts reading a line into a buffer with serial_line_feed().
+ @param line The line state to reset
+ @param buffer Where to collect the line
+ @param len The size of buffer, at least 2
+*/
+void serial_line_start(struct serial_line *line, char *buffer, size_t len);
+
+/**
+ Edits a line with one received byte, echoing the change to the port, or
+ to the screen for CONSOLE, in a single write of the shortest escape
+ sequences that do it. Handles backspace, delete, the left and right
+ arrow keys, and Up and Down to step through the port's history of
+ completed lines.
+ @param line The line state
+ @param dev The port to echo to, or CONSOLE
+ @param ch The byte received
+ @return Non-zero once the line is complete and NUL-terminated, either at
+         a carriage return (stored as a newline) or when the buffer is full
+*/
+int serial_line_feed(struct serial_line *line, device dev, char ch);
+
+/**
+ Changes the line settings of a port once its queued output is sent.
+ With flow control on, output waits for CTS and RTS is dropped while
+ the receive ring is nearly full.
+ @param dev The serial port
+ @param config The settings to use
+ @return 0 on success, -1 if the port is not initialized, -2 if a setting
+         is not supported
+*/
+int serial_configure(device dev, const struct serial_config *config);
+
+/**
+ Reports the line settings of a port.
+ @param dev The serial port
+ @param config Filled in with the settings
+ @return 0 on success, non-zero if the port is not initialized
+*/
+int serial_get_config(device dev, struct serial_config *config);
+
+/**
+ Reports the transmit counters of a port.
+ @param dev The serial port
+ @param stats Filled in with the counters
+ @return 0 on success, non-zero if the port is not initialized
+*/
+int serial_get_stats(device dev, struct serial_stats *stats);
+
 /**
  Writes a buffer to a serial port
  @param device The serial port to output to
@@ -30,7 +179,8 @@ int serial_out(device dev, const char *buffer, size_t len);
  @param device The serial port to read data from
  @param buffer A buffer to write data into as it is read from the serial port
  @param count The maximum number of bytes to read
- @return The number of bytes read on success, a negative number on failure
+ @return The number of bytes read on success, -1 if the device is not an
+         initialized serial port
 */   		   
 
 int serial_poll(device dev, char *buffer, size_t len);
@@ -0,0 +1,64 @@
+#ifndef MPX_SHM_H
+#define MPX_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ @file mpx/shm.h
+ @brief Named shared memory regions, reference counted by attached process
+*/
+
+/** Start of the virtual region shared memory lives in */
+#define SHM_REGION_BASE		0xF0000000
+
+/** Virtual space reserved per region, and so the largest region */
+#define SHM_SLOT_SIZE		0x100000
+
+/** Number of regions that may exist at once; one bit each in a process mask */
+#define SHM_MAX_REGIONS		32
+
+/** Longest region name */
+#define SHM_NAME_LEN		15
+
+/** What showshm needs to know about a region */
+struct shm_info {
+	const char *name;	/** the name it was created with */
+	void *addr;		/** the same for every process */
+	size_t size;		/** bytes backed by frames */
+	unsigned int attached;	/** processes attached to it */
+};
+
+/**
+ Attaches the running process to a region, creating it if it does not exist.
+ A new region is backed by zeroed frames, rounded up to whole pages.
+ Attaching a process twice has no further effect.
+ @param name The name of the region
+ @param size The size wanted, in bytes, or 0 to only attach to an existing one
+ @return NULL on error, otherwise the page-aligned address of the region
+*/
+void *shm_attach(const char *name, size_t size);
+
+/**
+ Detaches the running process from a region. The region's frames are freed
+ once nothing is attached to it.
+ @param name The name of the region
+ @return 0 on success, non-zero if the process was not attached
+*/
+int shm_detach(const char *name);
+
+/**
+ Detaches a process from every region it is attached to.
+ @param attached The process's attach mask, cleared on return
+*/
+void shm_release(uint32_t *attached);
+
+/**
+ Describes a region slot, for listing.
+ @param slot The slot, less than SHM_MAX_REGIONS
+ @param info Filled in if the slot is in use
+ @return 0 if the slot is in use, non-zero if not
+*/
+int shm_get_info(unsigned int slot, struct shm_info *info);
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef MPX_STACK_H
+#define MPX_STACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ @file mpx/stack.h
+ @brief Demand-grown process stacks with unmapped guard pages
+*/
+
+/** Start of the virtual region process stacks live in */
+#define STACK_REGION_BASE	0xE0000000
+
+/** Virtual space reserved per process stack, including its guard page */
+#define STACK_SLOT_SIZE		0x10000
+
+/** Number of stack slots in the region */
+#define STACK_SLOTS		256
+
+/** Largest stack a process may grow; the lowest page of a slot is a guard */
+#define STACK_MAX_LIMIT		(STACK_SLOT_SIZE - 0x1000)
+
+/** Stack limit used when load() is not given one */
+#define STACK_DEFAULT_LIMIT	0x4000
+
+/** Byte new stack pages are painted with, to measure how deep they got */
+#define STACK_PAINT		0xA5
+
+/** STACK_PAINT repeated across a word */
+#define STACK_PAINT_WORD	0xA5A5A5A5
+
+/** Eighths of its limit a stack may map before a warning is given */
+#define STACK_WARN_EIGHTHS	7
+
+/** Bytes of live stack held by each block of a swapped-out stack */
+#define STACK_SWAP_BLOCK	512
+
+struct stack_swap_block;
+
+/** A process stack. It grows down from top, one page at a time. */
+struct proc_stack {
+	uint32_t top;		/** one past the highest stack address */
+	uint32_t limit;		/** most bytes the stack may grow to */
+	uint32_t mapped;	/** bytes currently backed by frames */
+	int warned;		/** non-zero once stack_near_limit() reported it */
+	uint32_t peak;		/** deepest use seen before the last swap out */
+	uint32_t live;		/** bytes in use when swapped out */
+	uint32_t released;	/** bytes of frames given up by the swap out */
+	struct stack_swap_block *swapped;	/** live bytes while swapped out */
+};
+
+/** Memory reclaimed from the stacks that are currently swapped out */
+struct stack_swap_stats {
+	unsigned int stacks;	/** stacks swapped out */
+	size_t released;	/** bytes of frames unmapped */
+	size_t buffered;	/** bytes of swap blocks holding their live data */
+};
+
+/**
+ Services page faults on a separate task, so a process that runs off the
+ mapped part of its stack can be grown or stopped cleanly. Call after
+ vm_init().
+*/
+void stack_init(void);
+
+/**
+ Reserves a stack slot and maps the first page of the stack.
+ @param s The stack to set up
+ @param slot The stack slot to use, less than STACK_SLOTS
+ @param limit The most bytes the stack may grow to
+ @return 0 on success, non-zero on error
+*/
+int stack_alloc(struct proc_stack *s, unsigned int slot, size_t limit);
+
+/**
+ Measures the deepest the stack has ever been by scanning up from its lowest
+ mapped page for the first word that no longer holds the paint pattern.
+ @param s The stack to measure
+ @return The peak depth in bytes
+*/
+size_t stack_peak(const struct proc_stack *s);
+
+/**
+ Cheap check, done at dispatch, of whether a stack has mapped most of its
+ limit. Pages are only mapped when touched, so this bounds the real depth.
+ @param s The stack to check
+ @return Non-zero the first time the stack is found near its limit
+*/
+int stack_near_limit(struct proc_stack *s);
+
+/**
+ Copies the live part of a stack, from the saved stack pointer to the top,
+ into swap blocks and unmaps every frame behind it. Must not be called while
+ running on that stack.
+ @param s The stack to swap out
+ @param sp The saved stack pointer of the process
+ @return 0 on success, non-zero on error, leaving the stack in place
+*/
+int stack_swap_out(struct proc_stack *s, uint32_t sp);
+
+/**
+ Maps the pages covering the live part of a swapped-out stack again and
+ copies it back. Deeper pages are mapped on demand as usual.
+ @param s The stack to swap in
+ @return 0 on success or if the stack was not swapped out, non-zero on error
+*/
+int stack_swap_in(struct proc_stack *s);
+
+/**
+ Reports the memory reclaimed by swapped-out stacks.
+ @param stats Filled in with the current totals
+*/
+void stack_get_swap_stats(struct stack_swap_stats *stats);
+
+/**
+ Unmaps a stack and returns its frames, or its swap blocks if it is swapped
+ out. Must not be called while running on that stack.
+ @param s The stack to release
+*/
+void stack_free(struct proc_stack *s);
+
+#endif
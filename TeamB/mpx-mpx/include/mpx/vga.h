@@ -0,0 +1,35 @@
+#ifndef MPX_VGA_H
+#define MPX_VGA_H
+
+#include <stddef.h>
+
+/**
+ @file mpx/vga.h
+ @brief Console on the text-mode screen, written straight into video memory
+*/
+
+/** Columns of the 80x25 colour text mode the BIOS leaves set up */
+#define VGA_COLS 80
+
+/** Rows of the text mode */
+#define VGA_ROWS 25
+
+/**
+ Clears the screen to light grey on black and homes the cursor.
+*/
+void vga_init(void);
+
+/**
+ Writes bytes to the screen at the cursor, scrolling at the bottom, and
+ moves the hardware cursor once at the end. Besides printable characters
+ it handles carriage return, newline (which also returns the carriage),
+ backspace and tab, and the ANSI sequences ESC [ n A/B/C/D and row;col H/f
+ to move the cursor, J and K to erase, @ and P to insert and delete
+ characters, and m for colours. A sequence may be split across writes.
+ @param buffer The bytes to write
+ @param len The number of bytes to write
+ @return len, as the screen never has to be waited on
+*/
+int vga_write(const char *buffer, size_t len);
+
+#endif
@@ -7,6 +7,8 @@
 */
 
 #include <stddef.h>
+#include <stdint.h>
+#include <mpx/multiboot.h>
 
 /**
  Allocates memory from a primitive heap.
@@ -18,11 +20,52 @@
  */
 void *kmalloc(size_t size, int align, void **phys_addr);
 
+/**
+ Sizes the frame allocator and kernel heap from the Multiboot memory map.
+ Only ranges the map reports as available are handed out. Must be called
+ before vm_init(); if it is not, or finds no map, 64 MB is assumed.
+ @param magic The value the loader left in EAX
+ @param mbi The Multiboot information structure the loader left in EBX
+ @return The number of usable bytes found, or 0 if there was no map
+*/
+size_t vm_memory_init(uint32_t magic, const struct multiboot_info *mbi);
+
 /**
  Initializes the kernel page directory and initial kernel heap area.
  Performs identity mapping of the kernel frames such that the virtual
- addresses are equivalent to the physical addresses.
+ addresses are equivalent to the physical addresses. The kernel image and
+ heap are mapped with 4 MB pages when the CPU supports PSE, and with 4 KB
+ pages otherwise.
 */
 void vm_init(void);
 
+/** Size of a page */
+#define PAGE_SIZE	0x1000
+
+/**
+ Maps a page of kernel virtual memory onto a newly allocated frame.
+ Does nothing if the page is already mapped.
+ @param addr An address within the page
+ @return 0 on success, non-zero if the address cannot take a small page
+*/
+int vm_map_page(uint32_t addr);
+
+/**
+ Unmaps a page and returns its frame to the frame allocator.
+ @param addr An address within the page
+*/
+void vm_unmap_page(uint32_t addr);
+
+/**
+ Determines whether a page is mapped, with a small page or a large one.
+ @param addr An address within the page
+ @return Non-zero if mapped, 0 if not
+*/
+int vm_is_mapped(uint32_t addr);
+
+/**
+ Returns the physical address of the kernel page directory, for CR3.
+*/
+uint32_t vm_page_directory(void);
+
 #endif
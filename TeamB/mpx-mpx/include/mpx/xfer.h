@@ -0,0 +1,76 @@
+#ifndef MPX_XFER_H
+#define MPX_XFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mpx/device.h>
+
+/**
+ @file mpx/xfer.h
+ @brief Framed binary transfers over a serial port, checked with CRC32
+
+ Every frame is XFER_MAGIC0, XFER_MAGIC1, a type byte, a sequence byte,
+ a little-endian 16-bit payload length, the payload, and the CRC32 of
+ everything from the type byte to the end of the payload, little-endian.
+ A transfer is a START frame holding the total length, DATA frames, and
+ an END frame holding the CRC32 of the whole blob. The sender waits for
+ the ACK of each frame and resends it on a NAK or a timeout, so bytes
+ that are not frames (console text, say) are skipped by the receiver.
+ The sequence byte counts frames from START and wraps past 255.
+ tools/xfer is the host side.
+*/
+
+/** First two bytes of every frame */
+#define XFER_MAGIC0		0xA5
+#define XFER_MAGIC1		0x5A
+
+/** Largest payload in one frame */
+#define XFER_MAX_PAYLOAD	1024
+
+/** Milliseconds the other end may stay quiet, before a frame or inside one */
+#define XFER_TIMEOUT_MS		1000
+
+/** Times a frame is sent before the transfer is abandoned */
+#define XFER_RETRIES		8
+
+/** Timeouts waited for the other end to show up before giving up */
+#define XFER_START_TRIES	30
+
+/** Frame types */
+#define XFER_START	'S'
+#define XFER_DATA	'D'
+#define XFER_END	'E'
+#define XFER_ACK	'A'
+#define XFER_NAK	'N'
+#define XFER_ABORT	'X'
+
+/**
+ Updates a CRC32 (the zlib polynomial) with more data.
+ @param crc 0 to start, or the result for the data before
+ @param data The bytes to add
+ @param len The number of bytes
+ @return The CRC32 of everything so far
+*/
+uint32_t xfer_crc32(uint32_t crc, const void *data, size_t len);
+
+/**
+ Sends a blob to the host tool. The port must be open for interrupt-driven
+ I/O; other processes get to run while this waits.
+ @param dev The serial port
+ @param data The bytes to send
+ @param len The number of bytes
+ @return 0 once the receiver acknowledged everything, non-zero on failure
+*/
+int xfer_send(device dev, const void *data, size_t len);
+
+/**
+ Receives a blob from the host tool.
+ @param dev The serial port
+ @param buffer Where to put the blob
+ @param size The size of buffer; a longer blob is refused
+ @param received Set to the length of the blob
+ @return 0 once the whole blob arrived intact, non-zero on failure
+*/
+int xfer_recv(device dev, void *buffer, size_t size, size_t *received);
+
+#endif
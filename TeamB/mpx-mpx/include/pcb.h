@@ -3,8 +3,13 @@
 
 #include <stdint.h>
 #include <mpx/sys_call.h>
+#include <mpx/arena.h>
+#include <mpx/stack.h>
+#include <mpx/dcb.h>
+#include <stdio.h>
 
-#define STACK_SIZE 1024
+// Number of PCBs preallocated by kmain()
+#define PCB_POOL_CAPACITY 64
 
 // PCB Classes
 #define USER_APP 0
@@ -13,37 +18,103 @@
 // PCB execution states
 #define READY 0
 #define BLOCKED 1
+#define ZOMBIE 2  // Exited, waiting to be reaped
+
+// Lowest scheduling priority, held by the idle process
+#define LOWEST_PRIORITY 9
+
+// Zombies that accumulate before sys_call() reaps them outside idle time
+#define REAP_BATCH 8
 
 // PCB dispatching states
 #define NOT_SUSPENDED 0
 #define SUSPENDED 1
 
-// PCB structure
+// Longest process name, not counting the NUL terminator
+#define PCB_NAME_LEN 8
+
+// Cold PCB data, kept out of line so queue walks never touch it
+struct pcb_cold {
+    char process_name[PCB_NAME_LEN + 1];
+    struct arena arena;  // Memory the process allocated through sys_alloc_mem()
+    struct proc_stack stack;  // Demand-grown stack in its own virtual slot
+    int exit_status;  // Status passed to EXIT, kept until the PCB is reaped
+    uint32_t shm_attached;  // One bit per shared memory region slot attached
+    struct print_buffer out;  // printf() output not yet written
+    int pid;  // Unique for the life of the system, never reused
+    int parent_pid;  // Process that may WAIT for this one, 0 if none
+    struct pcb *waiter;  // Parent blocked in WAIT for this process
+    struct pcb *waiting_on;  // Child this process is blocked in WAIT for
+    int wait_status;  // Exit status collected by the last WAIT
+    struct iocb io;  // READ or WRITE this process is blocked on, if queued
+    device console;  // Port the process reads commands from and writes to
+};
+
+// Hot scheduling descriptor. Descriptors sit in one contiguous array and
+// hold only what pcb_insert(), pcb_find() and pcb_remove() look at.
 struct pcb {
-    char process_name[8];
-    int process_class;
-    int process_priority;
-    int execution_state;
-    int dispatching_state;
-    unsigned char stack[STACK_SIZE];  // Allocate memory for the stack
-    unsigned char *stack_ptr;  // Pointer to the top of the stack
     struct pcb *next;
+    uint32_t name_hash;  // pcb_name_hash() of the process name
+    uint8_t process_class;
+    uint8_t process_priority;
+    uint8_t execution_state;
+    uint8_t dispatching_state;
+    unsigned char *stack_ptr;  // Pointer to the top of the stack
+    struct pcb_cold *cold;  // Name, stack and other out-of-line data
 };
 
+// The process currently dispatched by sys_call(), NULL when none is
+extern struct pcb *current_process;
+
 // PCB queue structures
 struct queue
 {
     struct pcb *front;
 };
 
-// Function to allocate memory for a new PCB
+// PCB pool usage counters
+struct pcb_pool_stats
+{
+    unsigned int capacity;    // PCBs in the pool
+    unsigned int in_use;      // PCBs currently handed out
+    unsigned int high_water;  // Most PCBs ever in use at once
+};
+
+// Function to preallocate a pool of PCBs, returns 0 on success
+int pcb_pool_init(unsigned int capacity);
+
+// Function to read the PCB pool usage counters
+void pcb_pool_get_stats(struct pcb_pool_stats *stats);
+
+// Function to take a PCB from the pool, NULL if the pool is exhausted
 struct pcb *allocate(void);
 
-// Function to free memory associated with a PCB
+// Function to return a PCB and everything it allocated to the pool
 int pcb_free(struct pcb *pcb);
 
-// Function to allocate and initialize a new PCB
-struct pcb *pcb_setup(const char *name, int process_class, int priority);
+// Function to allocate and initialize a new PCB (not yet queued)
+// with a stack that may grow to stack_limit bytes
+struct pcb *pcb_setup(const char *name, int process_class, int priority, size_t stack_limit);
+
+// Function to turn a PCB into a zombie; constant time, frees nothing
+void pcb_exit(struct pcb *pcb, int status);
+
+// Function to free every zombie except running, whose stack is in use
+unsigned int pcb_reap(const struct pcb *running);
+
+// Function to count the zombies waiting to be reaped
+unsigned int pcb_zombie_count(void);
+
+// Function to find a PCB by pid, zombies included
+struct pcb *pcb_find_pid(int pid);
+
+// Function for WAIT: collects an exited child's status into the parent's
+// wait_status and returns 0, returns 1 if the parent must block until the
+// child exits, or -1 if pid is not a child the parent may wait for
+int pcb_wait(struct pcb *parent, int pid);
+
+// Function to hash a process name for pcb_find()
+uint32_t pcb_name_hash(const char *name);
 
 // Function to find a PCB by name
 struct pcb *pcb_find(const char *name);
@@ -59,6 +130,9 @@ int pcb_set_priority(const char *name, int new_priority);
 
 void load_pcb(struct pcb *p, void (*proc)());
 
+// Function to get the console of the running process, COM1 if none is running
+device current_console(void);
+
 struct queue* get_ready_q(void);
 struct queue* get_blocked_q(void);
 struct queue* get_susp_ready_q(void);
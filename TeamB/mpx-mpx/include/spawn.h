@@ -0,0 +1,48 @@
+#ifndef MPX_SPAWN_H
+#define MPX_SPAWN_H
+
+#include <stddef.h>
+
+/**
+ @file spawn.h
+ @brief Starting processes with an argument, and waiting for them to exit
+*/
+
+/** Most bytes of argument spawn() will copy onto a new process's stack */
+#define SPAWN_ARG_MAX 1024
+
+/** spawn() flag: nobody will wait, so the process is reaped as soon as it exits */
+#define SPAWN_DETACHED 0x1
+
+/**
+ Creates a ready process that runs fn(arg) and exits with its return value.
+ @param name The process name, which should be unique
+ @param process_class USER_APP or SYSTEM_PROCESS
+ @param priority 0 (highest) to 9 (lowest)
+ @param fn The function the process runs
+ @param arg The argument for fn. If arg_size is non-zero, the argument is
+            copied onto the new process's stack and fn gets the copy.
+ @param arg_size Bytes of arg to copy, at most SPAWN_ARG_MAX, or 0 to pass arg as is
+ @param flags 0, or SPAWN_DETACHED
+ @return The pid of the new process, or -1 on error
+*/
+int spawn(const char *name, int process_class, int priority,
+	  int (*fn)(void *), const void *arg, size_t arg_size, int flags);
+
+/**
+ Blocks until a child created by spawn() without SPAWN_DETACHED exits.
+ A child's status can be collected once.
+ @param pid The pid spawn() returned
+ @param status If non-NULL, receives the child's exit status
+ @return 0 on success, -1 if pid is not such a child or the wait was
+         ended by unblockpcb
+*/
+int wait_pid(int pid, int *status);
+
+/**
+ Ends the running process with an exit status for wait_pid().
+ @param status The exit status
+*/
+void process_exit(int status);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef MPX_STDIO_H
+#define MPX_STDIO_H
+
+#include <stdarg.h>
+#include <stddef.h>
+
+/**
+ @file stdio.h
+ @brief Formatted output. Supports %d %i %u %x %X %o %c %s %p and %%, with
+ the '-' and '0' flags, a field width, a precision for strings, and '*' for
+ either. ll takes a 64-bit integer; the other length modifiers are accepted
+ and ignored, as int, long and size_t are all 32 bits.
+*/
+
+/** Bytes of output printf() holds for each process before writing */
+#define PRINT_BUFFER_SIZE 128
+
+/** Output waiting to be written for one process */
+struct print_buffer {
+	size_t len;
+	char data[PRINT_BUFFER_SIZE];
+};
+
+/**
+ Format into a buffer.
+ @param s The buffer to write to
+ @param n The size of the buffer; output is truncated to n - 1 bytes and NUL-terminated
+ @param format The format string
+ @param ap The arguments for the format string
+ @return The number of bytes the full output would take, not counting NUL
+*/
+int vsnprintf(char *s, size_t n, const char *format, va_list ap);
+
+/**
+ Format into a buffer.
+ @param s The buffer to write to
+ @param n The size of the buffer; output is truncated to n - 1 bytes and NUL-terminated
+ @param format The format string
+ @return The number of bytes the full output would take, not counting NUL
+*/
+int snprintf(char *s, size_t n, const char *format, ...)
+	__attribute__((format(printf, 3, 4)));
+
+/**
+ Format into the running process's print buffer. The buffer is written with
+ a single WRITE when it fills, when the output contains a newline, or when
+ printf_flush() is called.
+ @param format The format string
+ @return The number of bytes formatted
+*/
+int printf(const char *format, ...)
+	__attribute__((format(printf, 1, 2)));
+
+/**
+ Write out whatever printf() has buffered for the running process.
+ @return 0 on success, non-zero if the WRITE failed
+*/
+int printf_flush(void);
+
+#endif
@@ -13,4 +13,13 @@
 */
 int atoi(const char *s);
 
+/**
+ Convert an integer to a NUL-terminated string
+ @param value The integer to convert
+ @param s A buffer large enough to hold the result (12 bytes for base 10)
+ @param base The radix to convert to, between 2 and 16
+ @return s
+*/
+char *itoa(int value, char *s, int base);
+
 #endif
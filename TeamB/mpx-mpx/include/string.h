@@ -17,6 +17,24 @@
 */
 void* memcpy(void * restrict dst, const void * restrict src, size_t n);
 
+/**
+ Copy a region of memory that may overlap the destination.
+ @param dst The destination memory region
+ @param src The source memory region
+ @param n The number of bytes to copy
+ @return A pointer to the destination memory region
+*/
+void* memmove(void *dst, const void *src, size_t n);
+
+/**
+ Compare two regions of memory.
+ @param s1 The first memory region
+ @param s2 The second memory region
+ @param n The number of bytes to compare
+ @return 0 if the regions are equal, <0 if s1 has the lower first differing byte, >0 otherwise
+*/
+int memcmp(const void *s1, const void *s2, size_t n);
+
 /**
  Fill a region of memory.
  @param address The start of the memory region
@@ -13,6 +13,7 @@ typedef enum {
 	IDLE,
 	READ,
 	WRITE,
+	WAIT,
 } op_code;
     
 // error codes
@@ -20,8 +21,12 @@ typedef enum {
 #define INVALID_BUFFER		(-2)
 #define INVALID_COUNT		(-3)
 
+// READ or WRITE made with no process running to block; sys_req() polls instead
+#define POLL_DEVICE		(-5)
+
 /**
- Request an MPX kernel operation.
+ Request an MPX kernel operation. WAIT and an EXIT status need arguments
+ sys_req() does not pass; use wait_pid() and process_exit() from spawn.h.
  @param op_code One of READ, WRITE, IDLE, or EXIT
  @param ... As required for READ or WRITE
  @return Varies by operation
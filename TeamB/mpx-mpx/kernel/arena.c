@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <mpx/arena.h>
+#include <mpx/vm.h>
+#include <pcb.h>
+
+// chunks are handed out on 8-byte boundaries
+#define ARENA_ALIGN(n)	(((n) + 7) & ~(size_t)7)
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;		// usable bytes following the header
+	size_t used;		// bytes carved out so far
+	size_t last;		// where the newest allocation starts, if it can be undone
+};
+
+#define CHUNK_DATA(c)	((unsigned char *)(c) + ARENA_ALIGN(sizeof(struct arena_chunk)))
+
+// chunks returned by released arenas, reused before touching the kernel heap
+static struct arena_chunk *free_chunks = NULL;
+static struct arena_chunk *free_large = NULL;
+
+void arena_init(struct arena *a)
+{
+	a->chunks = NULL;
+	a->tail = NULL;
+	a->large = NULL;
+	a->large_tail = NULL;
+	a->used = 0;
+	a->reserved = 0;
+}
+
+static struct arena_chunk *chunk_new(size_t size)
+{
+	struct arena_chunk *c =
+	    kmalloc(ARENA_ALIGN(sizeof(struct arena_chunk)) + size, 0, NULL);
+	if (c != NULL) {
+		c->size = size;
+	}
+	return c;
+}
+
+/* Takes a standard chunk off the free list, or makes a new one */
+static struct arena_chunk *chunk_get(void)
+{
+	struct arena_chunk *c = free_chunks;
+	if (c != NULL) {
+		free_chunks = c->next;
+		return c;
+	}
+	return chunk_new(ARENA_CHUNK_SIZE);
+}
+
+/* First fit over the released oversized chunks, or a new exact-size chunk */
+static struct arena_chunk *chunk_get_large(size_t size)
+{
+	struct arena_chunk **link = &free_large;
+	while (*link != NULL) {
+		struct arena_chunk *c = *link;
+		if (c->size >= size) {
+			*link = c->next;
+			return c;
+		}
+		link = &c->next;
+	}
+	return chunk_new(size);
+}
+
+void *arena_alloc(struct arena *a, size_t size)
+{
+	size = ARENA_ALIGN(size);
+	if (size == 0) {
+		return NULL;
+	}
+
+	// requests that don't fit a standard chunk get a chunk of their own
+	if (size > ARENA_CHUNK_SIZE) {
+		struct arena_chunk *c = chunk_get_large(size);
+		if (c == NULL) {
+			return NULL;
+		}
+		c->used = size;
+		c->next = a->large;
+		if (a->large == NULL) {
+			a->large_tail = c;
+		}
+		a->large = c;
+		a->used += size;
+		a->reserved += c->size;
+		return CHUNK_DATA(c);
+	}
+
+	struct arena_chunk *c = a->chunks;
+	if (c == NULL || c->size - c->used < size) {
+		c = chunk_get();
+		if (c == NULL) {
+			return NULL;
+		}
+		c->used = 0;
+		c->last = 0;
+		c->next = a->chunks;
+		if (a->chunks == NULL) {
+			a->tail = c;
+		}
+		a->chunks = c;
+		a->reserved += c->size;
+	}
+
+	void *p = CHUNK_DATA(c) + c->used;
+	c->last = c->used;
+	c->used += size;
+	a->used += size;
+	return p;
+}
+
+void arena_free(struct arena *a, void *ptr)
+{
+	// an oversized chunk holds one allocation, so it goes back whole
+	struct arena_chunk *prev = NULL;
+	for (struct arena_chunk *c = a->large; c != NULL; prev = c, c = c->next) {
+		if (CHUNK_DATA(c) != ptr) {
+			continue;
+		}
+		if (prev != NULL) {
+			prev->next = c->next;
+		} else {
+			a->large = c->next;
+		}
+		if (a->large_tail == c) {
+			a->large_tail = prev;
+		}
+		a->used -= c->used;
+		a->reserved -= c->size;
+		c->next = free_large;
+		free_large = c;
+		return;
+	}
+
+	// otherwise only the newest allocation can be taken back
+	struct arena_chunk *c = a->chunks;
+	if (c == NULL || c->last == c->used || CHUNK_DATA(c) + c->last != ptr) {
+		return;
+	}
+	a->used -= c->used - c->last;
+	c->used = c->last;
+	if (c->used == 0) {
+		a->chunks = c->next;
+		if (a->chunks == NULL) {
+			a->tail = NULL;
+		}
+		a->reserved -= c->size;
+		c->next = free_chunks;
+		free_chunks = c;
+	}
+}
+
+void arena_release(struct arena *a)
+{
+	// splice both chains onto the free lists without walking them
+	if (a->chunks != NULL) {
+		a->tail->next = free_chunks;
+		free_chunks = a->chunks;
+	}
+	if (a->large != NULL) {
+		a->large_tail->next = free_large;
+		free_large = a->large;
+	}
+	arena_init(a);
+}
+
+void *arena_heap_alloc(size_t size)
+{
+	if (current_process == NULL) {
+		return kmalloc(size, 0, NULL);
+	}
+	return arena_alloc(&current_process->cold->arena, size);
+}
+
+int arena_heap_free(void *ptr)
+{
+	// kernel heap memory is never given back
+	if (current_process != NULL) {
+		arena_free(&current_process->cold->arena, ptr);
+	}
+	return 0;
+}
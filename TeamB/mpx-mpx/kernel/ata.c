@@ -0,0 +1,238 @@
+#include <stdint.h>
+#include <mpx/ata.h>
+#include <mpx/io.h>
+
+// Command block registers of the primary channel, and its control register
+#define ATA_BASE	0x1F0
+#define ATA_CONTROL	0x3F6
+
+enum ata_registers {
+	DATA = 0,
+	ERROR = 1,
+	SECCOUNT = 2,
+	LBA_LO = 3,
+	LBA_MID = 4,
+	LBA_HI = 5,
+	DRIVE = 6,
+	STATUS = 7,	// when read
+	COMMAND = 7,	// when written
+};
+
+enum ata_bits {
+	ST_ERR = 0x01,
+	ST_DRQ = 0x08,		// the disk is ready to move a sector of data
+	ST_DF = 0x20,		// device fault
+	ST_BSY = 0x80,
+	CTL_NIEN = 0x02,	// keeps the disk from raising IRQ 14
+	DRIVE_MASTER = 0xA0,
+	DRIVE_LBA = 0xE0,	// the master, addressed by LBA
+	ID_LBA = 0x0200,	// in word 49 of IDENTIFY: LBA is supported
+};
+
+enum ata_commands {
+	CMD_READ_SECTORS = 0x20,
+	CMD_WRITE_SECTORS = 0x30,
+	CMD_FLUSH_CACHE = 0xE7,
+	CMD_IDENTIFY = 0xEC,
+};
+
+// Status polls before a disk that doesn't answer is given up on
+#define ATA_TIMEOUT	0x1000000
+
+static int present = 0;
+static struct ata_info disk;
+
+/* Gives the drive the 400 ns it needs to put up a valid status */
+static void delay400(void)
+{
+	for (int i = 0; i < 4; i++) {
+		(void)inb(ATA_CONTROL);
+	}
+}
+
+/* Waits for BSY to clear; the status then, or -1 on timeout */
+static int wait_idle(void)
+{
+	for (uint32_t i = 0; i < ATA_TIMEOUT; i++) {
+		uint8_t st = inb(ATA_BASE + STATUS);
+		if (!(st & ST_BSY)) {
+			return st;
+		}
+	}
+	return -1;
+}
+
+/* Waits for BSY to clear and, if drq is set, for the disk to want data */
+static int wait_ready(int drq)
+{
+	for (uint32_t i = 0; i < ATA_TIMEOUT; i++) {
+		uint8_t st = inb(ATA_BASE + STATUS);
+		if (st & ST_BSY) {
+			continue;
+		}
+		if (st & (ST_ERR | ST_DF)) {
+			return -2;
+		}
+		if (!drq || (st & ST_DRQ)) {
+			return 0;
+		}
+	}
+	return -2;
+}
+
+static void read_words(void *buffer, size_t words)
+{
+	__asm__ volatile ("rep insw"
+			  : "+D"(buffer), "+c"(words)
+			  : "d"(ATA_BASE + DATA)
+			  : "memory");
+}
+
+static void write_words(const void *buffer, size_t words)
+{
+	__asm__ volatile ("rep outsw"
+			  : "+S"(buffer), "+c"(words)
+			  : "d"(ATA_BASE + DATA)
+			  : "memory");
+}
+
+/* Whether a transfer is one the disk can take */
+static int in_range(uint32_t lba, unsigned int count)
+{
+	return present && count > 0 && count <= ATA_MAX_SECTORS
+	    && lba < disk.sectors && count <= disk.sectors - lba;
+}
+
+/* Selects the master and loads the address and length of a transfer */
+static void setup(uint32_t lba, unsigned int count)
+{
+	outb(ATA_BASE + DRIVE, DRIVE_LBA | ((lba >> 24) & 0x0F));
+	delay400();
+	outb(ATA_BASE + SECCOUNT, count & 0xFF);	// 256 is sent as 0
+	outb(ATA_BASE + LBA_LO, lba & 0xFF);
+	outb(ATA_BASE + LBA_MID, (lba >> 8) & 0xFF);
+	outb(ATA_BASE + LBA_HI, (lba >> 16) & 0xFF);
+}
+
+int ata_init(void)
+{
+	present = 0;
+
+	// with no controller the bus floats and reads back as all ones
+	if (inb(ATA_BASE + STATUS) == 0xFF) {
+		return -1;
+	}
+	outb(ATA_CONTROL, CTL_NIEN);
+	outb(ATA_BASE + DRIVE, DRIVE_MASTER);
+	delay400();
+	outb(ATA_BASE + SECCOUNT, 0);
+	outb(ATA_BASE + LBA_LO, 0);
+	outb(ATA_BASE + LBA_MID, 0);
+	outb(ATA_BASE + LBA_HI, 0);
+	outb(ATA_BASE + COMMAND, CMD_IDENTIFY);
+	delay400();
+	if (inb(ATA_BASE + STATUS) == 0 || wait_idle() < 0) {
+		return -1;
+	}
+
+	// ATAPI and SATA devices abort IDENTIFY and leave a signature here
+	if (inb(ATA_BASE + LBA_MID) != 0 || inb(ATA_BASE + LBA_HI) != 0
+	    || wait_ready(1) != 0) {
+		return -1;
+	}
+
+	uint16_t id[256];
+	read_words(id, 256);
+	if (!(id[49] & ID_LBA)) {
+		return -1;
+	}
+	disk.sectors = id[60] | ((uint32_t)id[61] << 16);
+
+	// the model is space-padded ASCII with the bytes of each word swapped
+	for (int i = 0; i < 20; i++) {
+		disk.model[2 * i] = (char)(id[27 + i] >> 8);
+		disk.model[2 * i + 1] = (char)(id[27 + i] & 0xFF);
+	}
+	int end = 40;
+	while (end > 0 && disk.model[end - 1] == ' ') {
+		end--;
+	}
+	disk.model[end] = '\0';
+
+	present = disk.sectors != 0;
+	return present ? 0 : -1;
+}
+
+int ata_get_info(struct ata_info *info)
+{
+	if (!present) {
+		return -1;
+	}
+	*info = disk;
+	return 0;
+}
+
+int ata_read(uint32_t lba, unsigned int count, void *buffer)
+{
+	if (!in_range(lba, count)) {
+		return -1;
+	}
+	if (wait_ready(0) != 0) {
+		return -2;
+	}
+	setup(lba, count);
+	outb(ATA_BASE + COMMAND, CMD_READ_SECTORS);
+
+	// the disk raises DRQ once per sector it has ready
+	uint8_t *p = buffer;
+	for (unsigned int i = 0; i < count; i++) {
+		delay400();
+		if (wait_ready(1) != 0) {
+			return -2;
+		}
+		read_words(p, ATA_SECTOR_SIZE / 2);
+		p += ATA_SECTOR_SIZE;
+	}
+	return 0;
+}
+
+int ata_write(uint32_t lba, unsigned int count, const void *buffer)
+{
+	if (!in_range(lba, count)) {
+		return -1;
+	}
+	if (wait_ready(0) != 0) {
+		return -2;
+	}
+	setup(lba, count);
+	outb(ATA_BASE + COMMAND, CMD_WRITE_SECTORS);
+
+	const uint8_t *p = buffer;
+	for (unsigned int i = 0; i < count; i++) {
+		delay400();
+		if (wait_ready(1) != 0) {
+			return -2;
+		}
+		write_words(p, ATA_SECTOR_SIZE / 2);
+		p += ATA_SECTOR_SIZE;
+	}
+
+	// done once the last sector has left the disk's buffer
+	delay400();
+	return wait_ready(0);
+}
+
+int ata_flush(void)
+{
+	if (!present) {
+		return -1;
+	}
+	if (wait_ready(0) != 0) {
+		return -2;
+	}
+	outb(ATA_BASE + DRIVE, DRIVE_LBA);
+	delay400();
+	outb(ATA_BASE + COMMAND, CMD_FLUSH_CACHE);
+	delay400();
+	return wait_ready(0);
+}
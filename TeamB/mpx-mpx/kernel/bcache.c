@@ -0,0 +1,305 @@
+#include <stdint.h>
+#include <mpx/ata.h>
+#include <mpx/bcache.h>
+#include <mpx/klog.h>
+#include <mpx/vm.h>
+#include <string.h>
+
+// Buckets in the block number hash; a power of two
+#define HASH_SIZE	64
+#define HASH(block)	((block) & (HASH_SIZE - 1))
+
+// Block number of a buffer holding nothing
+#define NO_BLOCK	0xFFFFFFFF
+
+// Blocks moved by the largest single disk command the cache issues
+#define STAGING_BLOCKS	(1 + BCACHE_READAHEAD)
+
+struct buf {
+	uint32_t block;		// NO_BLOCK while unused
+	int dirty;		// changed since it was read or last written back
+	int prefetched;		// read ahead, and not asked for yet
+	struct buf *newer;	// towards the most recently used
+	struct buf *older;
+	struct buf *hash_next;
+	uint8_t *data;
+};
+
+static struct buf bufs[BCACHE_BLOCKS];
+static struct buf *hash[HASH_SIZE];
+static struct buf *newest = NULL;
+static struct buf *oldest = NULL;
+
+// contiguous room for a read-ahead run or a run of write-backs
+static uint8_t *staging = NULL;
+
+static uint32_t disk_blocks = 0;
+static uint32_t last_read = NO_BLOCK;
+static int ready = 0;
+static struct bcache_stats stats;
+
+static void lru_unlink(struct buf *b)
+{
+	if (b->newer != NULL) {
+		b->newer->older = b->older;
+	} else {
+		newest = b->older;
+	}
+	if (b->older != NULL) {
+		b->older->newer = b->newer;
+	} else {
+		oldest = b->newer;
+	}
+	b->newer = b->older = NULL;
+}
+
+static void lru_push(struct buf *b)
+{
+	b->newer = NULL;
+	b->older = newest;
+	if (newest != NULL) {
+		newest->newer = b;
+	} else {
+		oldest = b;
+	}
+	newest = b;
+}
+
+static struct buf *lookup(uint32_t block)
+{
+	for (struct buf *b = hash[HASH(block)]; b != NULL; b = b->hash_next) {
+		if (b->block == block) {
+			return b;
+		}
+	}
+	return NULL;
+}
+
+static void hash_insert(struct buf *b)
+{
+	b->hash_next = hash[HASH(b->block)];
+	hash[HASH(b->block)] = b;
+}
+
+static void hash_remove(struct buf *b)
+{
+	if (b->block == NO_BLOCK) {
+		return;
+	}
+	struct buf **link = &hash[HASH(b->block)];
+	while (*link != NULL && *link != b) {
+		link = &(*link)->hash_next;
+	}
+	if (*link == b) {
+		*link = b->hash_next;
+	}
+	b->hash_next = NULL;
+}
+
+static int write_back(struct buf *b)
+{
+	int result = ata_write(b->block, 1, b->data);
+	if (result != 0) {
+		klog(KLOG_ERR, "bcache", "Writing back block %u failed", b->block);
+		return result;
+	}
+	b->dirty = 0;
+	stats.dirty--;
+	stats.writebacks++;
+	return 0;
+}
+
+/* Frees the least recently used buffer, writing it back first if dirty.
+   It is left out of the LRU list and the hash for the caller to fill. */
+static struct buf *take_buffer(void)
+{
+	struct buf *b = oldest;
+	if (b->dirty && write_back(b) != 0) {
+		return NULL;
+	}
+	lru_unlink(b);
+	hash_remove(b);
+	b->block = NO_BLOCK;
+	b->prefetched = 0;
+	return b;
+}
+
+/* Reads a missed block, and if ahead is set the uncached blocks following
+   it, with one disk command. The missed block ends up most recently used. */
+static int fill(uint32_t block, int ahead, struct buf **out)
+{
+	unsigned int count = 1;
+	while (ahead && count < STAGING_BLOCKS && block + count < disk_blocks
+	    && lookup(block + count) == NULL) {
+		count++;
+	}
+
+	int result = ata_read(block, count, staging);
+	if (result != 0) {
+		return result;
+	}
+	stats.disk_reads++;
+
+	// the furthest first, so they are older than the block asked for
+	for (unsigned int i = count; i-- > 0;) {
+		struct buf *b = take_buffer();
+		if (b == NULL) {
+			if (i == 0) {
+				return -2;
+			}
+			continue;
+		}
+		b->block = block + i;
+		b->prefetched = i > 0;
+		memcpy(b->data, staging + i * BCACHE_BLOCK_SIZE, BCACHE_BLOCK_SIZE);
+		hash_insert(b);
+		lru_push(b);
+		if (i > 0) {
+			stats.readahead++;
+		} else {
+			*out = b;
+		}
+	}
+	return 0;
+}
+
+int bcache_init(void)
+{
+	struct ata_info info;
+	if (ready) {
+		return 0;
+	}
+	if (ata_get_info(&info) != 0) {
+		return -1;
+	}
+
+	uint8_t *data = kmalloc(BCACHE_BLOCKS * BCACHE_BLOCK_SIZE, 0, NULL);
+	staging = kmalloc(STAGING_BLOCKS * BCACHE_BLOCK_SIZE, 0, NULL);
+	if (data == NULL || staging == NULL) {
+		return -1;
+	}
+	for (int i = 0; i < BCACHE_BLOCKS; i++) {
+		bufs[i].block = NO_BLOCK;
+		bufs[i].dirty = 0;
+		bufs[i].prefetched = 0;
+		bufs[i].hash_next = NULL;
+		bufs[i].data = data + i * BCACHE_BLOCK_SIZE;
+		lru_push(&bufs[i]);
+	}
+	memset(hash, 0, sizeof(hash));
+	memset(&stats, 0, sizeof(stats));
+	disk_blocks = info.sectors;
+	ready = 1;
+	return 0;
+}
+
+int bcache_read(uint32_t block, void *buffer)
+{
+	if (!ready || block >= disk_blocks) {
+		return -1;
+	}
+
+	struct buf *b = lookup(block);
+	if (b != NULL) {
+		stats.hits++;
+		if (b->prefetched) {
+			stats.readahead_hits++;
+			b->prefetched = 0;
+		}
+		lru_unlink(b);
+		lru_push(b);
+	} else {
+		stats.misses++;
+		int sequential = last_read != NO_BLOCK && block == last_read + 1;
+		int result = fill(block, sequential, &b);
+		if (result != 0) {
+			return result;
+		}
+	}
+
+	memcpy(buffer, b->data, BCACHE_BLOCK_SIZE);
+	last_read = block;
+	return 0;
+}
+
+int bcache_write(uint32_t block, const void *buffer)
+{
+	if (!ready || block >= disk_blocks) {
+		return -1;
+	}
+
+	// the whole block is replaced, so a miss needs no read
+	struct buf *b = lookup(block);
+	if (b != NULL) {
+		stats.hits++;
+		b->prefetched = 0;
+		lru_unlink(b);
+	} else {
+		stats.misses++;
+		b = take_buffer();
+		if (b == NULL) {
+			return -2;
+		}
+		b->block = block;
+		hash_insert(b);
+	}
+
+	memcpy(b->data, buffer, BCACHE_BLOCK_SIZE);
+	if (!b->dirty) {
+		b->dirty = 1;
+		stats.dirty++;
+	}
+	lru_push(b);
+	return 0;
+}
+
+int bcache_sync(void)
+{
+	if (!ready) {
+		return -1;
+	}
+
+	// lowest dirty block first, so neighbours go out in one command
+	uint32_t next = 0;
+	for (;;) {
+		struct buf *first = NULL;
+		for (int i = 0; i < BCACHE_BLOCKS; i++) {
+			struct buf *b = &bufs[i];
+			if (b->dirty && b->block >= next
+			    && (first == NULL || b->block < first->block)) {
+				first = b;
+			}
+		}
+		if (first == NULL) {
+			break;
+		}
+
+		struct buf *run[STAGING_BLOCKS];
+		unsigned int count = 0;
+		struct buf *b = first;
+		while (count < STAGING_BLOCKS && b != NULL && b->dirty) {
+			memcpy(staging + count * BCACHE_BLOCK_SIZE, b->data, BCACHE_BLOCK_SIZE);
+			run[count++] = b;
+			b = lookup(first->block + count);
+		}
+
+		int result = ata_write(first->block, count, staging);
+		if (result != 0) {
+			klog(KLOG_ERR, "bcache", "Writing back blocks %u-%u failed",
+			    first->block, first->block + count - 1);
+			return result;
+		}
+		for (unsigned int i = 0; i < count; i++) {
+			run[i]->dirty = 0;
+		}
+		stats.dirty -= count;
+		stats.writebacks += count;
+		next = first->block + count;
+	}
+	return ata_flush();
+}
+
+void bcache_get_stats(struct bcache_stats *out)
+{
+	*out = stats;
+}
@@ -32,6 +32,8 @@ multiboot_header:
 ;; kernel entry point
 start:
 	mov esp, stack + STACKSIZE	;; establish a stack
+	push ebx			;; multiboot info structure
+	push eax			;; multiboot magic number
 	call kmain			;; jump to C code
 
 	cli				;; disable interrupts
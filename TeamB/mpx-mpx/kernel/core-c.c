@@ -26,17 +26,32 @@ struct gdt_descriptor {
         struct gdt_entry * base;
 } __attribute__((packed));
 
-void gdt_init(void)
+/* static so that it has a permanent lifetime; TSS slots are filled in later */
+static struct gdt_entry table[] = {
+	{ 0x0000, 0x0, 0x0, 0x00, 0x00, 0x0 },	// NULL
+	{ 0xffff, 0x0, 0x0, 0x9a, 0xff, 0x0 },	// CS
+	{ 0xffff, 0x0, 0x0, 0x92, 0xff, 0x0 },	// DS
+	{ 0xffff, 0x0, 0x0, 0xfa, 0xff, 0x0 },	// User CS
+	{ 0xffff, 0x0, 0x0, 0xf2, 0xff, 0x0 },	// User DS
+	{ 0x0000, 0x0, 0x0, 0x00, 0x00, 0x0 },	// Kernel TSS
+	{ 0x0000, 0x0, 0x0, 0x00, 0x00, 0x0 },	// Page fault TSS
+};
+
+void gdt_install_tss(int selector, void *tss, size_t size)
 {
-	/* declared static so that they have permanenent lifetime while not being global */
-	static struct gdt_entry table[] = {
-		{ 0x0000, 0x0, 0x0, 0x00, 0x00, 0x0 },	// NULL
-		{ 0xffff, 0x0, 0x0, 0x9a, 0xff, 0x0 },	// CS
-		{ 0xffff, 0x0, 0x0, 0x92, 0xff, 0x0 },	// DS
-		{ 0xffff, 0x0, 0x0, 0xfa, 0xff, 0x0 },	// User CS
-		{ 0xffff, 0x0, 0x0, 0xf2, 0xff, 0x0 },	// User DS
-	};
+	uintptr_t base = (uintptr_t)tss;
+	struct gdt_entry *entry = &table[selector / sizeof(struct gdt_entry)];
+	entry->limit_low = (size - 1) & 0xFFFF;
+	entry->base_low = base & 0xFFFF;
+	entry->base_mid = (base >> 16) & 0xFF;
+	entry->access = 0x89;	// present, ring 0, available 32-bit TSS
+	entry->flags = ((size - 1) >> 16) & 0x0F;
+	entry->base_high = (base >> 24) & 0xFF;
+}
 
+void gdt_init(void)
+{
+	/* declared static so that it has a permanenent lifetime while not being global */
 	static struct gdt_descriptor gdt = {
 		.size = sizeof(table) - 1,
 		.base = table,
@@ -157,6 +172,11 @@ void idt_install(int vector, void (*handler)(void *))
 	idt_set_gate(vector, handler, 0x08, 0x8e);
 }
 
+void idt_install_task_gate(int vector, uint16_t tss_selector)
+{
+	idt_set_gate(vector, NULL, tss_selector, 0x85);
+}
+
 void irq_init(void)
 {  
 	// Necessary interrupt handlers for protected mode
@@ -219,6 +239,7 @@ void pic_init(void)
 #include <mpx/panic.h>
 #include <mpx/serial.h>
 #include <mpx/interrupts.h>
+#include <mpx/klog.h>
 #include <sys_req.h>
 #include <string.h>
 #include <stdnoreturn.h>
@@ -226,6 +247,7 @@ void pic_init(void)
 noreturn void kpanic(const char *msg)
 {
 	cli();
+	klog_drain();	// what led up to it
 	char prefix[] = "Panic: ";
 	char suffix[] = "\r\nPress Ctrl-A, then X to quit QEMU.\r\n";
 	serial_out(COM1, prefix, strlen(prefix));
@@ -241,6 +263,7 @@ noreturn void kpanic(const char *msg)
  * ************************************************************************/
 #include <mpx/panic.h>
 #include <mpx/vm.h>
+#include <mpx/multiboot.h>
 #include <limits.h>
 #include <string.h>
 #include <stdint.h>
@@ -249,18 +272,28 @@ noreturn void kpanic(const char *msg)
 // TODO: this is very magic
 #define KHEAP_BASE	0xD000000
 
-// The size of the primitive kernel heap
+// The minimum size of the primitive kernel heap
 #define KHEAP_SIZE	0x10000
 
+// The heap never grows past this, however much memory is installed
+#define KHEAP_MAX	0x10000000
+
 // 4 KB pages
 #define PAGE_SIZE	0x1000
 
-// 64 MB total memory
-// TODO: learn this from boot parameters
-#define MEM_SIZE	0x4000000
+// 4 MB pages, used when the CPU supports PSE
+#define LARGE_PAGE_SIZE	0x400000
+
+// frames covered by one large page
+#define LARGE_FRAMES	(LARGE_PAGE_SIZE / PAGE_SIZE)
+
+// page directory entry flags
+#define PDE_PRESENT	0x01
+#define PDE_WRITEABLE	0x02
+#define PDE_LARGE	0x80
 
-// number of frames
-#define NFRAMES		(MEM_SIZE / PAGE_SIZE)
+// 64 MB total memory, assumed when the loader provides no memory map
+#define MEM_SIZE	0x4000000
 
 // bits per frame
 #define FRAME_BIT	(sizeof(uint32_t) * CHAR_BIT)
@@ -296,8 +329,11 @@ typedef struct {
 	uint32_t tables_phys[1024];
 } page_dir;
 
-// bitmap of frames
-static uint32_t frames[NFRAMES / FRAME_BIT] = { 0 };
+// bitmap of frames, sized from the boot memory map
+static uint32_t *frames = NULL;
+
+// number of frames tracked by the bitmap; a multiple of LARGE_FRAMES
+static uint32_t nframes = 0;
 
 // kernel page directory
 static page_dir *kdir;
@@ -312,14 +348,22 @@ static uintptr_t phys_alloc_addr = (uintptr_t) & __end;
 // if 0, allocate physical memory, otherwise virtual
 static int heap_is_initialized = 0;
 
-static uint32_t alloc(uint32_t size)
+// size of the kernel heap; rounded up to whole large pages under PSE
+static uint32_t kheap_size = KHEAP_SIZE;
+
+static uint32_t alloc(uint32_t size, int page_align)
 {
 	static uint32_t heap_addr = KHEAP_BASE;
 
+	// page tables must start on a page boundary
+	if (page_align) {
+		heap_addr = (heap_addr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	}
+
 	uint32_t base = heap_addr;
 	heap_addr += size;
 
-	if (heap_addr > KHEAP_BASE + KHEAP_SIZE) {
+	if (heap_addr > KHEAP_BASE + kheap_size) {
 		kpanic("Heap is full!");
 	}
 
@@ -334,6 +378,11 @@ static page_entry *get_page(uint32_t addr, page_dir * dir, int make_table)
 	uint32_t index = addr / PAGE_SIZE / 1024;
 	uint32_t offset = addr / PAGE_SIZE % 1024;
 
+	// covered by a large page; there is no table to return
+	if (dir->tables_phys[index] & PDE_LARGE) {
+		return NULL;
+	}
+
 	// return it if it exists
 	if (dir->tables[index]) {
 		return &dir->tables[index]->pages[offset];
@@ -351,18 +400,29 @@ static page_entry *get_page(uint32_t addr, page_dir * dir, int make_table)
 	return NULL;
 }
 
+/*
+ Translates a mapped virtual address to its physical address.
+*/
+static uintptr_t virt_to_phys(uint32_t addr, page_dir * dir)
+{
+	uint32_t pde = dir->tables_phys[addr / LARGE_PAGE_SIZE];
+	if (pde & PDE_LARGE) {
+		return (pde & ~(LARGE_PAGE_SIZE - 1)) + (addr & (LARGE_PAGE_SIZE - 1));
+	}
+
+	page_entry *page = get_page(addr, dir, 0);
+	return (page->frameaddr * PAGE_SIZE) + (addr & (PAGE_SIZE - 1));
+}
+
 void *kmalloc(uint32_t size, int page_align, void **phys_addr)
 {
 	void *addr = NULL;
 
 	// Allocate on the kernel heap if one has been created
 	if (heap_is_initialized) {
-		addr = (void *)alloc(size);
+		addr = (void *)alloc(size, page_align);
 		if (phys_addr) {
-			page_entry *page = get_page((uint32_t) addr, kdir, 0);
-			*phys_addr =
-			    (void *)((page->frameaddr * 0x1000) +
-				     ((uintptr_t) addr & 0xFFF));
+			*phys_addr = (void *)virt_to_phys((uint32_t) addr, kdir);
 		}
 	}
 	// Else, allocate directly from physical memory
@@ -384,7 +444,7 @@ void *kmalloc(uint32_t size, int page_align, void **phys_addr)
 static uint32_t find_free(void)
 {
 	uint32_t i, j;
-	for (i = 0; i < NFRAMES / FRAME_BIT; i++)
+	for (i = 0; i < nframes / FRAME_BIT; i++)
 		if (frames[i] != 0xFFFFFFFF)	//if frame not full
 			for (j = 0; j < FRAME_BIT; j++)	//find first free bit
 				if (!(frames[i] & (1 << j)))
@@ -393,6 +453,32 @@ static uint32_t find_free(void)
 	return -1;		//no free frames
 }
 
+/* Finds the first run of free frames that can back an aligned large page */
+static uint32_t find_free_large(void)
+{
+	const uint32_t words = LARGE_FRAMES / FRAME_BIT;
+	for (uint32_t i = 0; i + words <= nframes / FRAME_BIT; i += words) {
+		uint32_t j = 0;
+		while (j < words && frames[i + j] == 0) {
+			j++;
+		}
+		if (j == words) {
+			return i * FRAME_BIT;
+		}
+	}
+
+	return -1;		//no free run
+}
+
+/* Marks every frame under a large page as in use */
+static void set_large(uint32_t addr)
+{
+	uint32_t index = addr / PAGE_SIZE / FRAME_BIT;
+	for (uint32_t j = 0; j < LARGE_FRAMES / FRAME_BIT; j++) {
+		frames[index + j] = 0xFFFFFFFF;
+	}
+}
+
 /* Marks a page frame bit as in use */
 static void set_bit(uint32_t addr)
 {
@@ -402,6 +488,15 @@ static void set_bit(uint32_t addr)
 	frames[index] |= (1 << offset);
 }
 
+/* Marks a page frame bit as free */
+static void clear_bit(uint32_t addr)
+{
+	uint32_t frame = addr / PAGE_SIZE;
+	uint32_t index = frame / FRAME_BIT;
+	uint32_t offset = frame % FRAME_BIT;
+	frames[index] &= ~(1 << offset);
+}
+
 /*
  Marks a frame as in use in the frame bitmap, sets up the page,
  and saves the frame index in the page.
@@ -425,14 +520,126 @@ static void new_frame(page_entry * page)
 	page->usermode = 0;
 }
 
-void vm_init(void)
+/*
+ Maps a page onto the frame with the same address, whatever the bitmap
+ says about it. Reserved ranges below the kernel stay identity mapped.
+*/
+static void identity_frame(page_entry * page, uint32_t addr)
 {
-	// create kernel directory
-	kdir = kmalloc(sizeof(*kdir), 1, 0);	//page aligned
-	memset(kdir, 0, sizeof(*kdir));
+	set_bit(addr);
+	page->present = 1;
+	page->frameaddr = addr / PAGE_SIZE;
+	page->writeable = 1;
+	page->usermode = 0;
+}
+
+/* Marks the frames in [base, base + len) as free */
+static void free_range(uint64_t base, uint64_t len)
+{
+	uint64_t end = base + len;
+	if (end > (uint64_t)nframes * PAGE_SIZE) {
+		end = (uint64_t)nframes * PAGE_SIZE;
+	}
+
+	// only whole frames are usable
+	for (uint64_t a = (base + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+	     a + PAGE_SIZE <= end; a += PAGE_SIZE) {
+		uint32_t frame = (uint32_t)(a / PAGE_SIZE);
+		frames[frame / FRAME_BIT] &= ~(1u << (frame % FRAME_BIT));
+	}
+}
+
+/* Allocates a bitmap covering top bytes of physical memory, all in use */
+static void frames_alloc(uint64_t top)
+{
+	if (top > 0x100000000ULL) {
+		top = 0x100000000ULL;
+	}
+	uint64_t count = (top + PAGE_SIZE - 1) / PAGE_SIZE;
+	count = (count + LARGE_FRAMES - 1) & ~(uint64_t)(LARGE_FRAMES - 1);
+	nframes = (uint32_t)count;
+
+	frames = kmalloc(nframes / FRAME_BIT * sizeof(uint32_t), 0, NULL);
+	memset(frames, 0xFF, nframes / FRAME_BIT * sizeof(uint32_t));
+}
+
+size_t vm_memory_init(uint32_t magic, const struct multiboot_info *mbi)
+{
+	uint64_t usable = 0;
+
+	if (magic != MULTIBOOT_BOOTLOADER_MAGIC || mbi == NULL) {
+		return 0;
+	}
 
+	if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
+		uintptr_t first = mbi->mmap_addr;
+		uintptr_t last = mbi->mmap_addr + mbi->mmap_length;
+		const struct multiboot_mmap_entry *e;
+
+		// size the bitmap for the highest usable address
+		uint64_t top = 0;
+		for (uintptr_t p = first; p < last; p += e->size + sizeof(e->size)) {
+			e = (const struct multiboot_mmap_entry *)p;
+			if (e->type == MULTIBOOT_MEMORY_AVAILABLE && e->addr + e->len > top) {
+				top = e->addr + e->len;
+			}
+		}
+		if (top == 0) {
+			return 0;
+		}
+		frames_alloc(top);
+
+		// then free only what the map calls available
+		for (uintptr_t p = first; p < last; p += e->size + sizeof(e->size)) {
+			e = (const struct multiboot_mmap_entry *)p;
+			if (e->type == MULTIBOOT_MEMORY_AVAILABLE) {
+				free_range(e->addr, e->len);
+				usable += e->len;
+			}
+		}
+	} else if (mbi->flags & MULTIBOOT_INFO_MEMORY) {
+		uint64_t upper = (uint64_t)mbi->mem_upper * 1024;
+		frames_alloc(0x100000 + upper);
+		free_range(0, (uint64_t)mbi->mem_lower * 1024);
+		free_range(0x100000, upper);
+		usable = (uint64_t)mbi->mem_lower * 1024 + upper;
+	} else {
+		return 0;
+	}
+
+	if (usable > 0xFFFFFFFFULL) {
+		usable = 0xFFFFFFFFULL;
+	}
+
+	// give a quarter of RAM to the kernel heap
+	kheap_size = (uint32_t)(usable / 4) & ~(uint32_t)(PAGE_SIZE - 1);
+	if (kheap_size < KHEAP_SIZE) {
+		kheap_size = KHEAP_SIZE;
+	}
+	if (kheap_size > KHEAP_MAX) {
+		kheap_size = KHEAP_MAX;
+	}
+
+	return (size_t)usable;
+}
+
+/* Returns non-zero if CPUID reports Page Size Extension support */
+static int cpu_has_pse(void)
+{
+	uint32_t eax, ebx, ecx, edx;
+	__asm__ volatile ("cpuid"
+			  : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx)
+			  : "a"(1));
+	return (edx >> 3) & 1;
+}
+
+/*
+ Maps the kernel image and heap with 4 KB pages.
+*/
+static void vm_map_small(void)
+{
 	// get pages for kernel heap
-	for (uint32_t i = KHEAP_BASE; i < (KHEAP_BASE + KHEAP_SIZE); i += 1) {
+	for (uint32_t i = KHEAP_BASE; i < (KHEAP_BASE + kheap_size); i += PAGE_SIZE) {
 		get_page(i, kdir, 1);
 	}
 
@@ -440,18 +647,82 @@ void vm_init(void)
 	// note: placement_addr gets incremented in get_page,
 	// so we're mapping the first frames as well
 	for (uint32_t i = 0; i < (phys_alloc_addr + 0x10000); i += PAGE_SIZE) {
-		new_frame(get_page(i, kdir, 1));
+		identity_frame(get_page(i, kdir, 1), i);
 	}
 
 	// allocate heap frames now that the placement addr has increased.
 	// placement addr increases here for heap
-	for (uint32_t i = KHEAP_BASE; i < (KHEAP_BASE + KHEAP_SIZE); i += PAGE_SIZE) {
+	for (uint32_t i = KHEAP_BASE; i < (KHEAP_BASE + kheap_size); i += PAGE_SIZE) {
 		new_frame(get_page(i, kdir, 1));
 	}
+}
+
+/*
+ Maps the kernel image and heap with 4 MB pages. The first 4 MB keep a
+ small-page table so that page 0 can be left unmapped.
+*/
+static void vm_map_large(void)
+{
+	// the only page table; allocating it moves the placement addr
+	get_page(0, kdir, 1);
+
+	uint32_t end = phys_alloc_addr + 0x10000;
+
+	// identity map the small-page part of used memory
+	for (uint32_t i = 0; i < end && i < LARGE_PAGE_SIZE; i += PAGE_SIZE) {
+		identity_frame(get_page(i, kdir, 1), i);
+	}
+
+	// anything above the first 4 MB is identity mapped a large page at a time
+	for (uint32_t i = LARGE_PAGE_SIZE; i < end; i += LARGE_PAGE_SIZE) {
+		set_large(i);
+		kdir->tables_phys[i / LARGE_PAGE_SIZE] = i | PDE_LARGE | PDE_WRITEABLE | PDE_PRESENT;
+	}
+
+	// back the heap with aligned runs of free frames
+	kheap_size = (kheap_size + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+	for (uint32_t i = KHEAP_BASE; i < (KHEAP_BASE + kheap_size); i += LARGE_PAGE_SIZE) {
+		uint32_t index = find_free_large();
+		if (index == (uint32_t) (-1)) {
+			kpanic("Out of memory");
+		}
+		set_large(index * PAGE_SIZE);
+		kdir->tables_phys[i / LARGE_PAGE_SIZE] =
+		    (index * PAGE_SIZE) | PDE_LARGE | PDE_WRITEABLE | PDE_PRESENT;
+	}
+}
+
+void vm_init(void)
+{
+	int pse = cpu_has_pse();
+
+	// no usable boot memory map; assume the historical 64 MB
+	if (frames == NULL) {
+		frames_alloc(MEM_SIZE);
+		free_range(0, MEM_SIZE);
+	}
+
+	// create kernel directory
+	kdir = kmalloc(sizeof(*kdir), 1, 0);	//page aligned
+	memset(kdir, 0, sizeof(*kdir));
+
+	if (pse) {
+		vm_map_large();
+	} else {
+		vm_map_small();
+	}
 
 	// generate a page fault for NULL pointer dereference
 	memset(&kdir->tables[0]->pages[0], 0, sizeof(kdir->tables[0]->pages[0]));
 
+	// large pages must be switched on before paging is
+	if (pse) {
+		uint32_t cr4;
+		__asm__ volatile ("mov %%cr4,%0" : "=b"(cr4));
+		cr4 |= 0x10;
+		__asm__ volatile ("mov %0,%%cr4" :: "b"(cr4));
+	}
+
 	// load the kernel page directory
 	__asm__ volatile ("mov %0,%%cr3" :: "b"(&kdir->tables_phys[0]));
 
@@ -463,3 +734,42 @@ void vm_init(void)
 
 	heap_is_initialized = 1;
 }
+
+int vm_map_page(uint32_t addr)
+{
+	page_entry *page = get_page(addr, kdir, 1);
+	if (page == NULL) {
+		return -1;	// inside a large page
+	}
+	if (!page->present) {
+		page->frameaddr = 0;
+		new_frame(page);
+	}
+	return 0;
+}
+
+void vm_unmap_page(uint32_t addr)
+{
+	page_entry *page = get_page(addr, kdir, 0);
+	if (page == NULL || !page->present) {
+		return;
+	}
+	clear_bit(page->frameaddr * PAGE_SIZE);
+	memset(page, 0, sizeof(*page));
+	__asm__ volatile ("invlpg (%0)" :: "r"(addr) : "memory");
+}
+
+int vm_is_mapped(uint32_t addr)
+{
+	uint32_t pde = kdir->tables_phys[addr / LARGE_PAGE_SIZE];
+	if (pde & PDE_LARGE) {
+		return pde & PDE_PRESENT;
+	}
+	page_entry *page = get_page(addr, kdir, 0);
+	return page != NULL && page->present;
+}
+
+uint32_t vm_page_directory(void)
+{
+	return (uint32_t)&kdir->tables_phys[0];
+}
@@ -0,0 +1,219 @@
+#include <mpx/dcb.h>
+#include <mpx/interrupts.h>
+#include <mpx/keyboard.h>
+#include <mpx/klog.h>
+#include <mpx/serial.h>
+#include <mpx/vga.h>
+#include <pcb.h>
+
+static struct dcb dcbs[5] = {
+	{ .dev = COM1 }, { .dev = COM2 }, { .dev = COM3 }, { .dev = COM4 },
+	{ .dev = CONSOLE },
+};
+
+#define NDCBS	(int)(sizeof(dcbs) / sizeof(dcbs[0]))
+
+static struct dcb *dcb_find(device dev)
+{
+	for (int i = 0; i < NDCBS; i++) {
+		if (dcbs[i].dev == dev) {
+			return &dcbs[i];
+		}
+	}
+	return NULL;
+}
+
+int io_open(device dev)
+{
+	struct dcb *d = dcb_find(dev);
+	if (d == NULL) {
+		return -1;
+	}
+	if (dev == CONSOLE) {
+		vga_init();
+		keyboard_init();
+	} else if (serial_irq_init(dev) != 0) {
+		return -1;
+	}
+	d->reads.head = d->reads.tail = NULL;
+	d->writes.head = d->writes.tail = NULL;
+	d->open = 1;
+	return 0;
+}
+
+/* Gets a new head request ready to be worked on */
+static void io_begin(struct dcb *d, struct iocb *io)
+{
+	if (io != NULL && io->op == READ) {
+		serial_line_start(&d->line, io->buffer, io->len);
+	}
+}
+
+/* Hands bytes to a device without waiting; the screen takes them all */
+static int dev_write(device dev, const char *buffer, size_t len)
+{
+	return dev == CONSOLE ? vga_write(buffer, len) : serial_write(dev, buffer, len);
+}
+
+/* Takes received bytes from a device without waiting */
+static int dev_read(device dev, char *buffer, size_t len)
+{
+	return dev == CONSOLE ? keyboard_read(buffer, len) : serial_read(dev, buffer, len);
+}
+
+/* Does what the device allows for the head request; its result once done */
+static int io_progress(struct dcb *d, struct iocb *io)
+{
+	if (io->op == WRITE) {
+		io->done += dev_write(d->dev, io->buffer + io->done,
+		    io->len - io->done);
+		return io->done == io->len ? (int)io->len : IO_PENDING;
+	}
+
+	char ch;
+	while (dev_read(d->dev, &ch, 1) == 1) {
+		if (serial_line_feed(&d->line, d->dev, ch)) {
+			return (int)d->line.count;
+		}
+	}
+	return IO_PENDING;
+}
+
+/* Takes the head request off a queue and starts the next */
+static void io_dequeue(struct dcb *d, struct iocb_queue *q)
+{
+	struct iocb *io = q->head;
+	q->head = io->next;
+	if (q->head == NULL) {
+		q->tail = NULL;
+	}
+	io->next = NULL;
+	io->queued = 0;
+	io_begin(d, q->head);
+}
+
+/* Readies a process whose request finished, with result as its return value */
+static void io_wake(struct iocb *io, int result)
+{
+	struct pcb *pcb = io->pcb;
+	((struct context *)pcb->stack_ptr)->eax = (uint32_t)result;
+	if (pcb->execution_state == BLOCKED && pcb_remove(pcb) == 0) {
+		pcb->execution_state = READY;
+		pcb_insert(pcb);
+	}
+}
+
+static void io_run(struct dcb *d, struct iocb_queue *q)
+{
+	while (q->head != NULL) {
+		struct iocb *io = q->head;
+		int result = io_progress(d, io);
+		if (result == IO_PENDING) {
+			return;
+		}
+		io_dequeue(d, q);
+		io_wake(io, result);
+	}
+}
+
+int io_request(struct pcb *pcb, op_code op, device dev, char *buffer, size_t len)
+{
+	struct dcb *d = dcb_find(dev);
+	if (d == NULL || !d->open) {
+		return -1;
+	}
+	if (buffer == NULL) {
+		return INVALID_BUFFER;
+	}
+
+	// a READ needs room for at least one byte and the NUL
+	if (len == 0 || (op == READ && len == 1)) {
+		if (len == 1) {
+			buffer[0] = '\0';
+		}
+		return 0;
+	}
+
+	struct iocb *io = &pcb->cold->io;
+	io->pcb = pcb;
+	io->op = op;
+	io->buffer = buffer;
+	io->len = len;
+	io->done = 0;
+	io->queued = 1;
+	io->next = NULL;
+
+	struct iocb_queue *q = op == READ ? &d->reads : &d->writes;
+	if (q->tail != NULL) {
+		q->tail->next = io;
+		q->tail = io;
+		return IO_PENDING;
+	}
+	q->head = q->tail = io;
+	io_begin(d, io);
+
+	// complete it here if the device can take it all, so the caller never blocks
+	int result = io_progress(d, io);
+	if (result != IO_PENDING) {
+		io_dequeue(d, q);
+	}
+	return result;
+}
+
+void io_schedule(void)
+{
+	serial_event_clear();
+	keyboard_event_clear();
+	for (int i = 0; i < NDCBS; i++) {
+		if (dcbs[i].open) {
+			io_run(&dcbs[i], &dcbs[i].reads);
+			io_run(&dcbs[i], &dcbs[i].writes);
+		}
+	}
+}
+
+void io_cancel(struct pcb *pcb)
+{
+	struct iocb *io = &pcb->cold->io;
+	if (!io->queued) {
+		return;
+	}
+
+	for (int i = 0; i < NDCBS; i++) {
+		struct dcb *d = &dcbs[i];
+		struct iocb_queue *q = io->op == READ ? &d->reads : &d->writes;
+		if (q->head == io) {
+			// a half-edited line is dropped; the next READ starts afresh
+			io_dequeue(d, q);
+			return;
+		}
+		for (struct iocb *prev = q->head; prev != NULL; prev = prev->next) {
+			if (prev->next == io) {
+				prev->next = io->next;
+				if (q->tail == io) {
+					q->tail = prev;
+				}
+				io->next = NULL;
+				io->queued = 0;
+				return;
+			}
+		}
+	}
+}
+
+void io_idle_process(void)
+{
+	for (;;) {
+		// with nothing else to do, the kernel log gets the console
+		klog_flush();
+
+		// sti takes effect after hlt starts, so an IRQ can't slip in between
+		cli();
+		if (serial_event_pending() || keyboard_event_pending()) {
+			sti();
+		} else {
+			__asm__ volatile ("sti\n\thlt");
+		}
+		sys_req(IDLE);
+	}
+}
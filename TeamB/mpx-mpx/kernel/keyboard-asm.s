@@ -0,0 +1,17 @@
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; Entry point for the keyboard IRQ. Saves the registers C code may clobber,
+; lets keyboard_interrupt() take the scancode and acknowledge the PIC, and
+; returns to whatever was interrupted.
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+bits 32
+global keyboard_isr
+
+extern keyboard_interrupt
+
+keyboard_isr:
+	pushad
+	cld			;; the C code expects the direction flag clear
+	call keyboard_interrupt
+	popad
+	iret
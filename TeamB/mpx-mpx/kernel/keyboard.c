@@ -0,0 +1,187 @@
+#include <stdint.h>
+#include <mpx/interrupts.h>
+#include <mpx/io.h>
+#include <mpx/keyboard.h>
+#include <string.h>
+
+// PS/2 controller ports, and the status bit saying a byte waits in the data port
+#define PS2_DATA	0x60
+#define PS2_STATUS	0x64
+#define PS2_OUTPUT_FULL	0x01
+
+// PIC ports, and the vector IRQ 0 was remapped to by pic_init()
+#define PIC1		0x20
+#define PIC1_DATA	0x21
+#define PIC_EOI		0x20
+#define IRQ_BASE	0x20
+#define KEYBOARD_IRQ	1
+
+// Scancode set 1, which the controller translates to by default
+enum scancodes {
+	SC_RELEASE = 0x80,	// set in the code of a key going up
+	SC_EXTENDED = 0xE0,	// prefix of the arrow keys and their kin
+	SC_LCTRL = 0x1D,	// the right one is the same code, extended
+	SC_LSHIFT = 0x2A,
+	SC_RSHIFT = 0x36,
+	SC_CAPS = 0x3A,
+	SC_UP = 0x48,
+	SC_LEFT = 0x4B,
+	SC_RIGHT = 0x4D,
+	SC_DOWN = 0x50,
+	SC_DELETE = 0x53,
+};
+
+// What each key below Caps Lock types, unshifted and shifted. Escape and
+// the modifiers type nothing, so they can't start a stray sequence.
+static const char keymap[] =
+    "\0\0" "1234567890-=" "\x7F\t" "qwertyuiop[]" "\r\0"
+    "asdfghjkl;'`" "\0\\" "zxcvbnm,./" "\0*\0 ";
+static const char keymap_shift[] =
+    "\0\0" "!@#$%^&*()_+" "\x7F\t" "QWERTYUIOP{}" "\r\0"
+    "ASDFGHJKL:\"~" "\0|" "ZXCVBNM<>?" "\0*\0 ";
+
+extern void keyboard_isr(void *);
+
+/* Typed bytes; only the IRQ handler puts, head and tail run freely */
+static struct {
+	char data[KEYBOARD_RING_SIZE];
+	volatile uint32_t head;
+	volatile uint32_t tail;
+} ring;
+
+static struct {
+	int shift;		// bit 0 for left shift held down, bit 1 for right
+	int ctrl;
+	int caps;
+	int extended;		// the last byte was SC_EXTENDED
+} mods;
+
+static volatile int event;
+
+/* Queues the bytes of one key, or none of them if they don't all fit */
+static void put(const char *bytes, size_t len)
+{
+	if (KEYBOARD_RING_SIZE - (ring.head - ring.tail) < len) {
+		return;
+	}
+	for (size_t i = 0; i < len; i++) {
+		ring.data[(ring.head + i) % KEYBOARD_RING_SIZE] = bytes[i];
+	}
+	ring.head += len;
+	event = 1;
+}
+
+static void key(uint8_t code)
+{
+	int extended = mods.extended;
+	mods.extended = 0;
+
+	if (code == SC_EXTENDED) {
+		mods.extended = 1;
+		return;
+	}
+	int down = !(code & SC_RELEASE);
+	code &= ~SC_RELEASE;
+
+	switch (code) {
+	case SC_LSHIFT:
+	case SC_RSHIFT:
+		// the extended ones are fake shifts sent around some keys
+		if (!extended) {
+			int bit = code == SC_LSHIFT ? 1 : 2;
+			mods.shift = down ? (mods.shift | bit) : (mods.shift & ~bit);
+		}
+		return;
+	case SC_LCTRL:
+		mods.ctrl = down;
+		return;
+	case SC_CAPS:
+		if (down) {
+			mods.caps = !mods.caps;
+		}
+		return;
+	}
+	if (!down) {
+		return;
+	}
+
+	// the keypad keys double as arrows; Num Lock is not tracked
+	switch (code) {
+	case SC_UP:
+		put("\x1B[A", 3);
+		return;
+	case SC_DOWN:
+		put("\x1B[B", 3);
+		return;
+	case SC_RIGHT:
+		put("\x1B[C", 3);
+		return;
+	case SC_LEFT:
+		put("\x1B[D", 3);
+		return;
+	case SC_DELETE:
+		put("\x1B[3~", 4);
+		return;
+	}
+
+	if (code >= sizeof(keymap) - 1) {
+		return;
+	}
+	char c = (mods.shift ? keymap_shift : keymap)[code];
+	if (extended && c != '\r') {
+		// of the rest, only keypad Enter types the same as its twin
+		return;
+	}
+	if (mods.caps && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+		c ^= 0x20;
+	}
+	if (mods.ctrl && ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'))) {
+		c &= 0x1F;
+	}
+	if (c != '\0') {
+		put(&c, 1);
+	}
+}
+
+/* Called by keyboard_isr for IRQ 1 */
+void keyboard_interrupt(void)
+{
+	if (inb(PS2_STATUS) & PS2_OUTPUT_FULL) {
+		key(inb(PS2_DATA));
+	}
+	outb(PIC1, PIC_EOI);
+}
+
+int keyboard_init(void)
+{
+	// throw away keys pressed before anyone was listening
+	while (inb(PS2_STATUS) & PS2_OUTPUT_FULL) {
+		(void)inb(PS2_DATA);
+	}
+	ring.head = ring.tail = 0;
+	memset(&mods, 0, sizeof(mods));
+
+	idt_install(IRQ_BASE + KEYBOARD_IRQ, keyboard_isr);
+	outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << KEYBOARD_IRQ));
+	return 0;
+}
+
+int keyboard_read(char *buffer, size_t len)
+{
+	size_t n = 0;
+	while (n < len && ring.tail != ring.head) {
+		buffer[n++] = ring.data[ring.tail % KEYBOARD_RING_SIZE];
+		ring.tail++;
+	}
+	return (int)n;
+}
+
+int keyboard_event_pending(void)
+{
+	return event;
+}
+
+void keyboard_event_clear(void)
+{
+	event = 0;
+}
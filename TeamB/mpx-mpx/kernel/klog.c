@@ -0,0 +1,154 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <mpx/interrupts.h>
+#include <mpx/klog.h>
+#include <mpx/serial.h>
+#include <stdio.h>
+#include <string.h>
+
+static struct klog_entry ring[KLOG_ENTRIES];
+static volatile uint32_t logged = 0;	// messages ever logged
+static uint32_t shown = 0;		// messages the flusher has got past
+static int console_level = KLOG_INFO;
+
+static const char *level_names[] = { "ERR", "WARN", "INFO", "DEBUG" };
+
+/* Disables interrupts, returning whether they were enabled */
+static int irq_save(void)
+{
+	uint32_t flags;
+	__asm__ volatile ("pushf\n\tpop %0\n\tcli" : "=r"(flags) :: "memory");
+	return (flags & 0x200) != 0;
+}
+
+static void irq_restore(int enabled)
+{
+	if (enabled) {
+		sti();
+	}
+}
+
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+void klog(int level, const char *tag, const char *fmt, ...)
+{
+	// formatting inside the slot, with interrupts off, keeps an ISR's
+	// message from landing in the middle of this one
+	int enabled = irq_save();
+	struct klog_entry *e = &ring[logged % KLOG_ENTRIES];
+	e->timestamp = rdtsc();
+	e->seq = logged;
+	e->level = level;
+	size_t len = strlen(tag);
+	if (len > KLOG_TAG_LEN) {
+		len = KLOG_TAG_LEN;
+	}
+	memcpy(e->tag, tag, len);
+	e->tag[len] = '\0';
+
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(e->msg, sizeof(e->msg), fmt, ap);
+	va_end(ap);
+	logged++;
+	irq_restore(enabled);
+}
+
+int klog_read(uint32_t *cursor, struct klog_entry *entry)
+{
+	int enabled = irq_save();
+	uint32_t oldest = logged > KLOG_ENTRIES ? logged - KLOG_ENTRIES : 0;
+	if (*cursor < oldest) {
+		*cursor = oldest;
+	}
+	int found = *cursor < logged;
+	if (found) {
+		*entry = ring[*cursor % KLOG_ENTRIES];
+		(*cursor)++;
+	}
+	irq_restore(enabled);
+	return found;
+}
+
+/* Formats a message as a console line; the time is in units of 1024 cycles */
+static int format(const struct klog_entry *e, char *line, size_t size)
+{
+	return snprintf(line, size, "[%10u] %s %s: %s\r\n",
+	    (unsigned int)(e->timestamp >> 10), level_names[e->level], e->tag, e->msg);
+}
+
+/* Moves the flusher to the next message the console level lets through */
+static int next_shown(struct klog_entry *e)
+{
+	while (klog_read(&shown, e)) {
+		if (e->level <= console_level) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void klog_flush(void)
+{
+	char line[KLOG_MSG_LEN + 40];
+	struct klog_entry e;
+
+	for (;;) {
+		uint32_t at = shown;
+		if (!next_shown(&e)) {
+			return;
+		}
+		// a line only goes out whole; otherwise wait for the ring to drain
+		int n = format(&e, line, sizeof(line));
+		if (n > (int)sizeof(line) - 1) {
+			n = sizeof(line) - 1;
+		}
+		int room = serial_tx_room(COM1);
+		if (room < 0) {
+			serial_out(COM1, line, n);	// a polled port just takes it
+		} else if (room < n) {
+			shown = at;
+			return;
+		} else {
+			serial_write(COM1, line, n);
+		}
+	}
+}
+
+void klog_drain(void)
+{
+	char line[KLOG_MSG_LEN + 40];
+	struct klog_entry e;
+
+	while (next_shown(&e)) {
+		int n = format(&e, line, sizeof(line));
+		if (n > (int)sizeof(line) - 1) {
+			n = sizeof(line) - 1;
+		}
+		serial_out(COM1, line, n);
+	}
+}
+
+int klog_set_level(int level)
+{
+	if (level < KLOG_ERR || level > KLOG_DEBUG) {
+		return -1;
+	}
+	console_level = level;
+	return 0;
+}
+
+int klog_get_level(void)
+{
+	return console_level;
+}
+
+const char *klog_level_name(int level)
+{
+	return level >= KLOG_ERR && level <= KLOG_DEBUG ? level_names[level] : "?";
+}
@@ -2,23 +2,31 @@
 #include <mpx/gdt.h>
 #include <mpx/interrupts.h>
 #include <mpx/serial.h>
+#include <mpx/dcb.h>
+#include <mpx/klog.h>
 #include <mpx/vm.h>
+#include <mpx/multiboot.h>
+#include <mpx/arena.h>
+#include <mpx/stack.h>
+#include <mpx/ata.h>
+#include <mpx/bcache.h>
 #include <sys_req.h>
 #include <string.h>
+#include <stdio.h>
 #include <memory.h>
 #include "../user/interface.h"
 #include "pcb.h"
 #include "processes.h"
 
+// Boot messages go to the kernel log, which is written out in one go
+// before commhand starts (or by kpanic() if boot goes wrong)
 static void klogv(device dev, const char* msg)
 {
-	char prefix[] = "klogv: ";
-	serial_out(dev, prefix, strlen(prefix));
-	serial_out(dev, msg, strlen(msg));
-	serial_out(dev, "\r\n", 2);
+	(void)dev;
+	klog(KLOG_INFO, "boot", "%s", msg);
 }
 
-void kmain(void)
+void kmain(uint32_t magic, struct multiboot_info *mbi)
 {
 	// 0) Serial I/O -- <mpx/serial.h>
 	// If we don't initialize the serial port, we have no way of
@@ -70,6 +78,31 @@ void kmain(void)
 	sti();
 	klogv(COM1, "Enabling Interrupts...");
 
+	// Receive and transmit on COM1 from now on happen in its IRQ handler,
+	// so typed-ahead input waits in a ring instead of being lost, and
+	// a process's READ or WRITE blocks it in the kernel until done
+	io_open(COM1);
+	klogv(COM1, "Opening COM1 for interrupt-driven I/O...");
+
+	// Every other port with a UART behind it gets a console of its own
+	static const device extra_ports[] = { COM2, COM3, COM4 };
+	int consoles[3] = { 0 };
+	for (int i = 0; i < 3; i++) {
+		if (serial_detect(extra_ports[i]) && serial_init(extra_ports[i]) == 0
+		    && io_open(extra_ports[i]) == 0) {
+			consoles[i] = 1;
+			char msg[40];
+			snprintf(msg, sizeof(msg), "Opening COM%d for a console...", i + 2);
+			klogv(COM1, msg);
+		}
+	}
+
+	// The screen and keyboard make one more, which never waits on a line rate
+	int screen = io_open(CONSOLE) == 0;
+	if (screen) {
+		klogv(COM1, "Opening the VGA screen and PS/2 keyboard for a console...");
+	}
+
 	// 7) Virtual Memory (VM) -- <mpx/vm.h>
 	// Virtual Memory (VM) allows the CPU to map logical addresses used by
 	// programs to physical address in RAM. This allows each process to
@@ -79,32 +112,77 @@ void kmain(void)
 	// Read, Write, or Execute for pages of memory. VM is managed through
 	// Page Tables, data structures that describe the logical-to-physical
 	// mapping as well as manage permissions and other metadata.
+	// The frame allocator and heap are sized from the memory map the
+	// bootloader passed in, so more RAM for the VM means more for MPX.
+	size_t usable = vm_memory_init(magic, mbi);
+	if (usable != 0) {
+		char msg[48];
+		snprintf(msg, sizeof(msg), "Detected usable memory (KB): %u", usable / 1024);
+		klogv(COM1, msg);
+	} else {
+		klogv(COM1, "No boot memory map, assuming 64 MB...");
+	}
 	vm_init();
 	klogv(COM1, "Initializing Virtual Memory...");
 
+	// Page faults are serviced by their own task, so a process stack can
+	// be grown on demand and an overflow into its guard page is caught.
+	stack_init();
+	klogv(COM1, "Initializing demand-grown process stacks...");
+
+	// A disk on the primary IDE channel (QEMU's -hda) is used through a
+	// write-back block cache, whose buffers come from the kernel heap
+	struct ata_info disk;
+	if (ata_init() == 0 && bcache_init() == 0 && ata_get_info(&disk) == 0) {
+		char msg[80];
+		snprintf(msg, sizeof(msg), "Found ATA disk of %u sectors: %s", disk.sectors, disk.model);
+		klogv(COM1, msg);
+	} else {
+		klogv(COM1, "No ATA disk on the primary IDE channel...");
+	}
+
 	// 8) MPX Modules -- *headers vary*
 	// Module specific initialization -- not all modules require this.
 	klogv(COM1, "Initializing MPX modules...");
-	// R5: sys_set_heap_functions(...);
+	// R5: allocations made by a running process come from its own arena
+	sys_set_heap_functions(arena_heap_alloc, arena_heap_free);
 	// R4: create commhand and idle processes
+	pcb_pool_init(PCB_POOL_CAPACITY);
 
 
 	// 9) YOUR command handler -- *create and #include an appropriate .h file*
 	// Pass execution to your command handler so the user can interact with
 	// the system.
 	klogv(COM1, "Transferring control to commhand...");
+	klog_drain();
 	load("Comhand", SYSTEM_PROCESS, 0, comhand);
-	load("Sys_i", SYSTEM_PROCESS, 9, sys_idle_process);
+	for (int i = 0; i < 3; i++) {
+		char name[PCB_NAME_LEN + 1];
+		snprintf(name, sizeof(name), "Comhand%d", i + 2);
+		struct pcb *p = consoles[i] ? load(name, SYSTEM_PROCESS, 0, comhand) : NULL;
+		if (p != NULL) {
+			p->cold->console = extra_ports[i];
+		}
+	}
+	struct pcb *local = screen ? load("ComhandV", SYSTEM_PROCESS, 0, comhand) : NULL;
+	if (local != NULL) {
+		local->cold->console = CONSOLE;
+	}
+	// The idle process halts instead of printing, as processes waiting
+	// on I/O leave it running whenever the console is quiet
+	load("Sys_i", SYSTEM_PROCESS, 9, io_idle_process);
 	__asm__ volatile ("int $0x60" :: "a"(IDLE));
 
 	// 10) System Shutdown -- *headers to be determined by your design*
 	// After your command handler returns, take care of any clean up that
 	// is necessary.
 	klogv(COM1, "Starting system shutdown procedure...");
+	bcache_sync();
 
 	// 11) Halt CPU -- *no headers necessary, no changes necessary*
 	// Execution of kmain() will complete and return to where it was called
 	// in boot.s, which will then attempt to power off Qemu or halt the CPU.
 	klogv(COM1, "Halting CPU...");
+	klog_drain();
 }
 
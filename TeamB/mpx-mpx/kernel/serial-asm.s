@@ -0,0 +1,17 @@
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; Entry point for the serial port IRQs. Saves the registers C code may
+; clobber, lets serial_interrupt() service the UARTs and the PIC, and
+; returns to whatever was interrupted.
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+bits 32
+global serial_isr
+
+extern serial_interrupt
+
+serial_isr:
+	pushad
+	cld			;; the C code expects the direction flag clear
+	call serial_interrupt
+	popad
+	iret
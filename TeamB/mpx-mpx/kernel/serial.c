@@ -1,8 +1,13 @@
 
+#include <stdint.h>
+#include <mpx/interrupts.h>
 #include <mpx/io.h>
+#include <mpx/klog.h>
 #include <mpx/serial.h>
+#include <mpx/vga.h>
 #include <sys_req.h>
 #include <string.h>
+#include <stdio.h>
 
 
 enum uart_registers {
@@ -20,8 +25,69 @@ enum uart_registers {
 	SCR = 7,	// Scratch
 };
 
+enum uart_bits {
+	IER_RX = 0x01,		// interrupt on received data
+	IER_THRE = 0x02,	// interrupt when THR empties
+	IER_MSR = 0x08,		// interrupt when a modem status line changes
+	IIR_NONE = 0x01,	// no interrupt pending
+	IIR_ID = 0x0E,		// interrupt identification bits
+	IIR_THRE = 0x02,
+	IIR_RX = 0x04,
+	IIR_LINE = 0x06,
+	IIR_TIMEOUT = 0x0C,
+	IIR_FIFO = 0xC0,	// both set when a working 16550A FIFO is on
+	LSR_DR = 0x01,		// data ready
+	LSR_THRE = 0x20,	// THR (and transmit FIFO) empty
+	LSR_TEMT = 0x40,	// transmitter completely idle
+	FCR_ENABLE = 0x01,
+	FCR_CLEAR_RX = 0x02,
+	FCR_CLEAR_TX = 0x04,
+	MCR_DTR = 0x01,
+	MCR_RTS = 0x02,		// tells the other end it may send
+	MCR_OUT2 = 0x08,	// gates the UART's interrupt onto the bus
+	MSR_CTS = 0x10,		// the other end says we may send
+};
+
+// Receive ring fill at which RTS is dropped, and raised again, under flow control
+#define RX_HIGH_WATER	(SERIAL_RING_SIZE * 3 / 4)
+#define RX_LOW_WATER	(SERIAL_RING_SIZE / 4)
+
+// PIC ports, and the vector IRQ 0 was remapped to by pic_init()
+#define PIC1		0x20
+#define PIC1_DATA	0x21
+#define PIC_EOI		0x20
+#define IRQ_BASE	0x20
+
 static int initialized[4] = { 0 };
 
+/* Single-producer, single-consumer byte ring; head and tail run freely */
+struct ring {
+	char data[SERIAL_RING_SIZE];
+	volatile uint32_t head;		// bytes ever put
+	volatile uint32_t tail;		// bytes ever taken
+};
+
+/* State of a port driven by interrupts */
+struct port {
+	struct ring rx;
+	struct ring tx;
+	int irq_mode;		// non-zero once serial_irq_init() succeeded
+	uint8_t ier;		// last value written to IER
+	uint32_t rx_overruns;	// bytes dropped because rx was full
+	int dropping;		// non-zero while input is being dropped
+	struct serial_stats stats;
+	struct serial_config config;
+	uint8_t mcr;		// last value written to MCR
+};
+
+static struct port ports[4];
+
+// set by the IRQ handler whenever a ring moved, cleared by serial_event_clear()
+static volatile int event;
+static const device devices[4] = { COM1, COM2, COM3, COM4 };
+
+extern void serial_isr(void *);
+
 static int serial_devno(device dev)
 {
 	switch (dev) {
@@ -29,169 +95,759 @@ static int serial_devno(device dev)
 	case COM2: return 1;
 	case COM3: return 2;
 	case COM4: return 3;
+	default: break;
 	}
 	return -1;
 }
 
+/* FCR bits selecting a receive FIFO trigger level, 0 if it isn't one */
+static uint8_t fcr_trigger(unsigned int level)
+{
+	switch (level) {
+	case 1: return 0x00;
+	case 4: return 0x40;
+	case 8: return 0x80;
+	case 14: return 0xC0;
+	}
+	return 0;
+}
+
+/* Writes a port's configuration to the UART; fcr says which FIFOs to clear */
+static void program(int dno, uint8_t fcr)
+{
+	device dev = devices[dno];
+	struct port *p = &ports[dno];
+	uint16_t divisor = SERIAL_MAX_BAUD / p->config.baud;
+
+	outb(dev + IER, 0x00);	//disable interrupts
+	outb(dev + LCR, 0x80);	//set line control register
+	outb(dev + DLL, divisor & 0xFF);	//set bsd least sig bit
+	outb(dev + DLM, divisor >> 8);	//brd most significant bit
+	outb(dev + LCR, 0x03);	//lock divisor; 8bits, no parity, one stop
+	outb(dev + FCR, fcr | FCR_ENABLE | fcr_trigger(p->config.fifo_trigger));
+	p->mcr = MCR_DTR | MCR_RTS | MCR_OUT2;
+	outb(dev + MCR, p->mcr);	//enable interrupts, rts/dsr set
+
+	if (p->irq_mode) {
+		p->ier = IER_RX;
+		if (p->config.flow_control) {
+			p->ier |= IER_MSR;
+		}
+		if (p->tx.head != p->tx.tail) {
+			p->ier |= IER_THRE;
+		}
+		outb(dev + IER, p->ier);
+	}
+}
+
+int serial_detect(device dev)
+{
+	if (serial_devno(dev) == -1) {
+		return 0;
+	}
+	// with nothing at the address, reads float and never echo both patterns
+	outb(dev + SCR, 0x5A);
+	if (inb(dev + SCR) != 0x5A) {
+		return 0;
+	}
+	outb(dev + SCR, 0xA5);
+	return inb(dev + SCR) == 0xA5;
+}
+
 int serial_init(device dev)
 {
 	int dno = serial_devno(dev);
 	if (dno == -1) {
 		return -1;
 	}
-	outb(dev + IER, 0x00);	//disable interrupts
-	outb(dev + LCR, 0x80);	//set line control register
-	outb(dev + DLL, 115200 / 9600);	//set bsd least sig bit
-	outb(dev + DLM, 0x00);	//brd most significant bit
-	outb(dev + LCR, 0x03);	//lock divisor; 8bits, no parity, one stop
-	outb(dev + FCR, 0xC7);	//enable fifo, clear, 14byte threshold
-	outb(dev + MCR, 0x0B);	//enable interrupts, rts/dsr set
+	ports[dno].config.baud = SERIAL_DEFAULT_BAUD;
+	ports[dno].config.fifo_trigger = 14;
+	ports[dno].config.flow_control = 0;
+	program(dno, FCR_CLEAR_RX | FCR_CLEAR_TX);
 	(void)inb(dev);		//read bit to reset port
+
+	// an 8250/16450 ignores FCR, so only trust the FIFO if IIR says it's on
+	struct serial_stats *st = &ports[dno].stats;
+	st->bytes_sent = 0;
+	st->fifo_refills = 0;
+	st->stall_cycles = 0;
+	st->fifo_depth =
+	    (inb(dev + IIR) & IIR_FIFO) == IIR_FIFO ? SERIAL_FIFO_DEPTH : 1;
 	initialized[dno] = 1;
 	return 0;
 }
 
+int serial_get_stats(device dev, struct serial_stats *stats)
+{
+	int dno = serial_devno(dev);
+	if (dno == -1 || initialized[dno] == 0) {
+		return -1;
+	}
+	*stats = ports[dno].stats;
+	return 0;
+}
+
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static int ring_put(struct ring *r, char c)
+{
+	if (r->head - r->tail == SERIAL_RING_SIZE) {
+		return 0;
+	}
+	r->data[r->head % SERIAL_RING_SIZE] = c;
+	r->head++;
+	return 1;
+}
+
+static int ring_get(struct ring *r, char *c)
+{
+	if (r->head == r->tail) {
+		return 0;
+	}
+	*c = r->data[r->tail % SERIAL_RING_SIZE];
+	r->tail++;
+	return 1;
+}
+
+/* Disables interrupts, returning whether they were enabled */
+static int irq_save(void)
+{
+	uint32_t flags;
+	__asm__ volatile ("pushf\n\tpop %0\n\tcli" : "=r"(flags) :: "memory");
+	return (flags & 0x200) != 0;
+}
+
+static void irq_restore(int enabled)
+{
+	if (enabled) {
+		sti();
+	}
+}
+
+/* Whether flow control lets us send to the other end */
+static int cts(int dno)
+{
+	return !ports[dno].config.flow_control
+	    || (inb(devices[dno] + MSR) & MSR_CTS);
+}
+
+/* Sets or clears RTS, telling the other end whether to send */
+static void set_rts(int dno, int on)
+{
+	struct port *p = &ports[dno];
+	int enabled = irq_save();
+	p->mcr = on ? (p->mcr | MCR_RTS) : (p->mcr & ~MCR_RTS);
+	outb(devices[dno] + MCR, p->mcr);
+	irq_restore(enabled);
+}
+
+/* Takes a received byte, raising RTS again once the ring has drained */
+static int rx_take(int dno, char *c)
+{
+	struct port *p = &ports[dno];
+	if (!ring_get(&p->rx, c)) {
+		return 0;
+	}
+	if (!(p->mcr & MCR_RTS) && p->rx.head - p->rx.tail <= RX_LOW_WATER) {
+		set_rts(dno, 1);
+	}
+	return 1;
+}
+
+/* Refills the empty transmit FIFO from the ring, or stops THRE interrupts.
+   While CTS is down nothing is sent; the modem status interrupt resumes. */
+static void tx_fill(int dno)
+{
+	struct port *p = &ports[dno];
+	unsigned int n = 0;
+	char c;
+	if (!cts(dno)) {
+		return;
+	}
+	while (n < p->stats.fifo_depth && ring_get(&p->tx, &c)) {
+		outb(devices[dno] + THR, c);
+		n++;
+	}
+	if (n > 0) {
+		p->stats.bytes_sent += n;
+		p->stats.fifo_refills++;
+		event = 1;
+	} else if (p->ier & IER_THRE) {
+		p->ier &= ~IER_THRE;
+		outb(devices[dno] + IER, p->ier);
+	}
+}
+
+static void service(int dno)
+{
+	device dev = devices[dno];
+	struct port *p = &ports[dno];
+	uint8_t iir;
+
+	while (!((iir = inb(dev + IIR)) & IIR_NONE)) {
+		switch (iir & IIR_ID) {
+		case IIR_RX:
+		case IIR_TIMEOUT:
+			while (inb(dev + LSR) & LSR_DR) {
+				if (ring_put(&p->rx, inb(dev + RBR))) {
+					p->dropping = 0;
+					continue;
+				}
+				p->rx_overruns++;
+				if (!p->dropping) {
+					// once per burst of lost input, not per byte
+					p->dropping = 1;
+					klog(KLOG_WARN, "serial", "COM%d receive ring full, dropping input", dno + 1);
+				}
+			}
+			if (p->config.flow_control && (p->mcr & MCR_RTS)
+			    && p->rx.head - p->rx.tail >= RX_HIGH_WATER) {
+				p->mcr &= ~MCR_RTS;
+				outb(dev + MCR, p->mcr);
+			}
+			event = 1;
+			break;
+		case IIR_THRE:
+			tx_fill(dno);
+			break;
+		case IIR_LINE:
+			(void)inb(dev + LSR);
+			break;
+		default:
+			// CTS coming back restarts a transmitter it held up
+			if ((inb(dev + MSR) & MSR_CTS) && (p->ier & IER_THRE)
+			    && (inb(dev + LSR) & LSR_THRE)) {
+				tx_fill(dno);
+			}
+			break;
+		}
+	}
+}
+
+/* Called by serial_isr for IRQ 3 and IRQ 4 */
+void serial_interrupt(void)
+{
+	for (int dno = 0; dno < 4; dno++) {
+		if (ports[dno].irq_mode) {
+			service(dno);
+		}
+	}
+	outb(PIC1, PIC_EOI);
+}
+
+int serial_event_pending(void)
+{
+	return event;
+}
+
+void serial_event_clear(void)
+{
+	event = 0;
+}
+
+int serial_irq_init(device dev)
+{
+	int dno = serial_devno(dev);
+	if (dno == -1 || initialized[dno] == 0) {
+		return -1;
+	}
+
+	struct port *p = &ports[dno];
+	int irq = (dev == COM1 || dev == COM3) ? 4 : 3;
+	int enabled = irq_save();
+	p->rx.head = p->rx.tail = 0;
+	p->tx.head = p->tx.tail = 0;
+	p->rx_overruns = 0;
+	p->irq_mode = 1;
+	p->ier = IER_RX;
+	if (p->config.flow_control) {
+		p->ier |= IER_MSR;
+	}
+	idt_install(IRQ_BASE + irq, serial_isr);
+	outb(dev + IER, p->ier);
+	outb(PIC1_DATA, inb(PIC1_DATA) & ~(1 << irq));
+	irq_restore(enabled);
+	return 0;
+}
+
+int serial_read(device dev, char *buffer, size_t len)
+{
+	int dno = serial_devno(dev);
+	if (dno == -1 || !ports[dno].irq_mode) {
+		return -1;
+	}
+	size_t n = 0;
+	while (n < len && rx_take(dno, &buffer[n])) {
+		n++;
+	}
+	return (int)n;
+}
+
+int serial_tx_room(device dev)
+{
+	int dno = serial_devno(dev);
+	if (dno == -1 || !ports[dno].irq_mode) {
+		return -1;
+	}
+	struct ring *r = &ports[dno].tx;
+	return SERIAL_RING_SIZE - (r->head - r->tail);
+}
+
+int serial_write(device dev, const char *buffer, size_t len)
+{
+	int dno = serial_devno(dev);
+	if (dno == -1 || !ports[dno].irq_mode) {
+		return -1;
+	}
+	struct port *p = &ports[dno];
+	size_t n = 0;
+	while (n < len && ring_put(&p->tx, buffer[n])) {
+		n++;
+	}
+
+	// an empty THR raises THRE as soon as it is enabled, starting the drain
+	int enabled = irq_save();
+	if (n > 0 && !(p->ier & IER_THRE)) {
+		p->ier |= IER_THRE;
+		outb(dev + IER, p->ier);
+	}
+	irq_restore(enabled);
+	return (int)n;
+}
+
+/* Waits for the transmitter to empty and CTS, counting the time spent */
+static void wait_thre(int dno)
+{
+	device dev = devices[dno];
+	if ((inb(dev + LSR) & LSR_THRE) && cts(dno)) {
+		return;
+	}
+	uint64_t start = rdtsc();
+	while (!(inb(dev + LSR) & LSR_THRE) || !cts(dno))
+		;
+	ports[dno].stats.stall_cycles += rdtsc() - start;
+}
+
+/* Sends bytes without interrupts, a FIFO's worth per THRE */
+static void poll_write(int dno, const char *buffer, size_t len);
+
+/* Empties the transmit ring without interrupts */
+static void tx_drain_polled(int dno)
+{
+	char queued[SERIAL_FIFO_DEPTH];
+	size_t n;
+	do {
+		for (n = 0; n < sizeof(queued); n++) {
+			if (!ring_get(&ports[dno].tx, &queued[n])) {
+				break;
+			}
+		}
+		poll_write(dno, queued, n);
+	} while (n == sizeof(queued));
+}
+
+static void poll_write(int dno, const char *buffer, size_t len)
+{
+	struct serial_stats *st = &ports[dno].stats;
+	while (len > 0) {
+		size_t n = len < st->fifo_depth ? len : st->fifo_depth;
+		wait_thre(dno);
+		for (size_t i = 0; i < n; i++) {
+			outb(devices[dno] + THR, buffer[i]);
+		}
+		st->bytes_sent += n;
+		st->fifo_refills++;
+		buffer += n;
+		len -= n;
+	}
+}
+
 int serial_out(device dev, const char *buffer, size_t len)
 {
 	int dno = serial_devno(dev);
 	if (dno == -1 || initialized[dno] == 0) {
 		return -1;
 	}
-	for (size_t i = 0; i < len; i++) {
-		outb(dev, buffer[i]);
+
+	if (ports[dno].irq_mode) {
+		int enabled = irq_save();
+		irq_restore(enabled);
+		if (enabled) {
+			// queue it all, sleeping while the ring drains
+			size_t done = 0;
+			while (done < len) {
+				done += serial_write(dev, buffer + done, len - done);
+				if (done < len) {
+					uint64_t start = rdtsc();
+					__asm__ volatile ("hlt");
+					ports[dno].stats.stall_cycles += rdtsc() - start;
+				}
+			}
+			return (int)len;
+		}
+
+		// no interrupts to drain the ring (e.g. a panic): empty it by hand
+		tx_drain_polled(dno);
 	}
+
+	poll_write(dno, buffer, len);
 	return (int)len;
 }
 
+int serial_get_config(device dev, struct serial_config *config)
+{
+	int dno = serial_devno(dev);
+	if (dno == -1 || initialized[dno] == 0) {
+		return -1;
+	}
+	*config = ports[dno].config;
+	return 0;
+}
+
+int serial_configure(device dev, const struct serial_config *config)
+{
+	int dno = serial_devno(dev);
+	if (dno == -1 || initialized[dno] == 0) {
+		return -1;
+	}
+	if (config->baud == 0 || config->baud > SERIAL_MAX_BAUD
+	    || SERIAL_MAX_BAUD % config->baud != 0
+	    || (config->fifo_trigger != 1 && fcr_trigger(config->fifo_trigger) == 0)) {
+		return -2;
+	}
 
-// Helper function to redraw characters from a position
-void redraw_from_position(device dev, char *buffer, size_t start, size_t end) {
-    for (size_t i = start; i < end; i++) {
-        serial_out(dev, &buffer[i], 1);
+	// what is already queued goes out at the old rate
+	struct port *p = &ports[dno];
+	if (p->irq_mode) {
+		int enabled = irq_save();
+		irq_restore(enabled);
+		while (p->tx.head != p->tx.tail) {
+			if (enabled) {
+				__asm__ volatile ("hlt");
+			} else {
+				tx_drain_polled(dno);
+			}
+		}
+	}
+	while (!(inb(dev + LSR) & LSR_TEMT))
+		;
+
+	int enabled = irq_save();
+	p->config = *config;
+	program(dno, FCR_CLEAR_TX);
+	irq_restore(enabled);
+	return 0;
+}
+
+/* Waits for the next received byte on an initialized port */
+static char serial_getc(int dno)
+{
+	device dev = devices[dno];
+	char c;
+	if (ports[dno].irq_mode) {
+		while (!rx_take(dno, &c)) {
+			__asm__ volatile ("hlt");
+		}
+		return c;
+	}
+	while (!(inb(dev + LSR) & LSR_DR))
+		;
+	return inb(dev + RBR);
+}
+
+
+/* Lines entered on a port, the oldest overwritten first */
+struct history {
+    char lines[SERIAL_HISTORY_SIZE][SERIAL_HISTORY_LINE];
+    unsigned int count;  // lines ever added
+    char draft[SERIAL_HISTORY_LINE];  // the line being typed before Up was pressed
+    size_t draft_len;
+};
+
+// one per COM port, then the screen console's
+#define CONSOLE_HISTORY 4
+static struct history histories[CONSOLE_HISTORY + 1];
+
+/* Echo of one edit, collected so it goes out in a single write */
+struct echo {
+    device dev;
+    size_t n;
+    char data[64];
+};
+
+static void echo_flush(struct echo *e)
+{
+    if (e->dev == CONSOLE) {
+        vga_write(e->data, e->n);
+        e->n = 0;
+        return;
+    }
+
+    // Queue it when the port is interrupt-driven, so a slow line doesn't hold
+    // up the caller; only a full ring falls back to waiting
+    int queued = serial_write(e->dev, e->data, e->n);
+    if (queued < 0) {
+        queued = 0;
+    }
+    if ((size_t)queued < e->n) {
+        serial_out(e->dev, e->data + queued, e->n - queued);
     }
+    e->n = 0;
 }
 
-// Helper function to move cursor left by a certain amount
-void move_cursor_left(device dev, size_t amount) {
-    for (size_t i = 0; i < amount; i++) {
-        serial_out(dev, "\x1B\x5B\x44", 3);  // ANSI sequence for moving cursor left
+static void echo_put(struct echo *e, const char *s, size_t len)
+{
+    while (len-- > 0) {
+        if (e->n == sizeof(e->data)) {
+            echo_flush(e);
+        }
+        e->data[e->n++] = *s++;
     }
 }
 
-int serial_poll(device dev, char *buffer, size_t len) {
-    size_t bytesRead = 0;
-    size_t cursorPosition = 0;  // Current position of the cursor
-    char ch;
-
-    while (bytesRead < len - 1) {  // -1 to leave space for null terminator
-        while (!(inb(dev + LSR) & 0x01));  // Wait until data is available         
-                                // LSR indicates data is available
-
-        ch = inb(dev);
-
-        // Handle escape sequences (arrow keys are escape sequences)
-        if (ch == '\x1B') {
-            char next1 = inb(dev);
-            char next2 = inb(dev);
-
-            if (next1 == '\x5B') {
-                switch (next2) {
-
-                    case '\x41':  // Up arrow
-                        // handle the Up arrow key here
-                        break;
-                    case '\x42':  // Down arrow
-                        // handle the Down arrow key here
-                        break;
-                    case '\x43':  // Right arrow
-                        // Move cursor to the right if it is not at the end
-                        if (cursorPosition < bytesRead) {
-                            serial_out(dev, "\x1B\x5B\x43", 3);
-                            cursorPosition++;
-                        }
-                        break;
-                    case '\x44':  // Left arrow
-                        // Move cursor to the left only if not at the start of the input
-                        if (cursorPosition > 0) {
-                            serial_out(dev, "\x1B\x5B\x44", 3);
-                            cursorPosition--;
-                        }
-                        break;
-                    default:
-                        break;
-                }
-                continue;  // Skip the rest of the loop for this iteration
+/* Moves the terminal cursor along the line with whichever form is shorter:
+   backspaces or reprinting the line for short moves, ESC [ n D/C for long */
+static void echo_move(struct echo *e, const char *line, size_t from, size_t to)
+{
+    char seq[16];
+    if (to < from) {
+        size_t n = from - to;
+        if (n < 4) {
+            while (n-- > 0) {
+                echo_put(e, "\b", 1);
             }
+        } else {
+            echo_put(e, seq, snprintf(seq, sizeof(seq), "\x1B[%uD", n));
         }
+    } else if (to > from) {
+        size_t n = to - from;
+        if (n < 4) {
+            echo_put(e, line + from, n);
+        } else {
+            echo_put(e, seq, snprintf(seq, sizeof(seq), "\x1B[%uC", n));
+        }
+    }
+}
 
-        switch (ch) {
-            case '\r':  // Carriage return
-                ch = '\n';  // Convert carriage return to newline
-                buffer[bytesRead++] = ch;
-                serial_out(dev, &ch, 1);  // Echo to user
-                break;
+static void history_add(struct history *h, const char *text, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    if (len > SERIAL_HISTORY_LINE - 1) {
+        len = SERIAL_HISTORY_LINE - 1;
+    }
 
-            case 0x7F:  // Backspace ascii for backspace
-            if (cursorPosition > 0) {
-                // Shift characters to the left starting from the cursor position
-                for (size_t i = cursorPosition - 1; i < bytesRead - 1; i++) {
-                    buffer[i] = buffer[i + 1];
-                }
-                bytesRead--;
-                cursorPosition--;
+    // Repeating the last command doesn't push older ones out
+    if (h->count > 0) {
+        const char *last = h->lines[(h->count - 1) % SERIAL_HISTORY_SIZE];
+        if (strlen(last) == len && memcmp(last, text, len) == 0) {
+            return;
+        }
+    }
+
+    char *slot = h->lines[h->count % SERIAL_HISTORY_SIZE];
+    memcpy(slot, text, len);
+    slot[len] = '\0';
+    h->count++;
+}
+
+/* Replaces the line with the index-th most recent history entry, 0 being
+   the line that was being typed, redrawing only from where they differ */
+static void recall(struct serial_line *line, struct history *h, struct echo *e,
+                   unsigned int index)
+{
+    unsigned int stored = h->count < SERIAL_HISTORY_SIZE ? h->count : SERIAL_HISTORY_SIZE;
+    if (index > stored) {
+        return;
+    }
+
+    if (line->recall == 0) {
+        h->draft_len = line->count < SERIAL_HISTORY_LINE ? line->count : SERIAL_HISTORY_LINE;
+        memcpy(h->draft, line->buffer, h->draft_len);
+    }
+
+    const char *text = h->draft;
+    size_t len = h->draft_len;
+    if (index > 0) {
+        text = h->lines[(h->count - index) % SERIAL_HISTORY_SIZE];
+        len = strlen(text);
+    }
+    if (len > line->len - 2) {
+        len = line->len - 2;  // leave room to keep typing
+    }
+
+    size_t same = 0;
+    while (same < len && same < line->count && line->buffer[same] == text[same]) {
+        same++;
+    }
+    echo_move(e, line->buffer, line->cursor, same);
+    echo_put(e, text + same, len - same);
+    if (len < line->count) {
+        echo_put(e, "\x1B[K", 3);  // erase the rest of the old line
+    }
+
+    memcpy(line->buffer + same, text + same, len - same);
+    line->count = len;
+    line->cursor = len;
+    line->recall = index;
+}
+
+void serial_line_start(struct serial_line *line, char *buffer, size_t len)
+{
+    line->buffer = buffer;
+    line->len = len;
+    line->count = 0;
+    line->cursor = 0;
+    line->escape = 0;
+    line->escape1 = 0;
+    line->recall = 0;
+}
 
-                // Move the cursor left
-                move_cursor_left(dev, 1);
+/* Applies one byte to the line, collecting its echo; non-zero when done */
+static int line_edit(struct serial_line *line, struct history *h, struct echo *e, char ch)
+{
+    char *buffer = line->buffer;
 
-                // Redraw from the current cursor position to the end of the buffer
-                redraw_from_position(dev, buffer, cursorPosition, bytesRead);
+    // Handle escape sequences (arrow keys are escape sequences)
+    if (line->escape == 1) {
+        line->escape1 = ch;
+        line->escape = 2;
+        return 0;
+    }
+    if (line->escape == 2) {
+        line->escape = 0;
+        if (line->escape1 == '\x5B') {
+            switch (ch) {
 
-                // Clear the character at the new end of the buffer
-                serial_out(dev, " ", 1);
+                case '\x41':  // Up arrow
+                    // Step back through the history
+                    recall(line, h, e, line->recall + 1);
+                    break;
+                case '\x42':  // Down arrow
+                    // Step forward, ending at the line that was being typed
+                    if (line->recall > 0) {
+                        recall(line, h, e, line->recall - 1);
+                    }
+                    break;
+                case '\x43':  // Right arrow
+                    // Move cursor to the right if it is not at the end
+                    if (line->cursor < line->count) {
+                        echo_move(e, buffer, line->cursor, line->cursor + 1);
+                        line->cursor++;
+                    }
+                    break;
+                case '\x44':  // Left arrow
+                    // Move cursor to the left only if not at the start of the input
+                    if (line->cursor > 0) {
+                        echo_move(e, buffer, line->cursor, line->cursor - 1);
+                        line->cursor--;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        return 0;
+    }
+
+    switch (ch) {
+        case '\x1B':
+            line->escape = 1;
+            return 0;
 
-                // Move the cursor back to its original position after clearing the character
-                move_cursor_left(dev, bytesRead - cursorPosition + 1 );
+        case '\r':  // Carriage return
+            // Convert carriage return to newline, which ends the line
+            history_add(h, buffer, line->count);
+            buffer[line->count++] = '\n';
+            buffer[line->count] = '\0';
+            echo_put(e, "\n", 1);  // Echo to user
+            return 1;
+
+        case 0x7F:  // Backspace ascii for backspace
+            if (line->cursor > 0) {
+                // Shift characters to the left starting from the cursor position
+                memmove(&buffer[line->cursor - 1], &buffer[line->cursor],
+                        line->count - line->cursor);
+                line->count--;
+                line->cursor--;
+
+                // At the end, blank the character; inside the line, have the
+                // terminal close the gap (DCH) rather than redraw the tail
+                if (line->cursor == line->count) {
+                    echo_put(e, "\b \b", 3);
+                } else {
+                    echo_put(e, "\b\x1B[P", 4);
+                }
             }
             break;
 
         case 0x7E:  // ASCII for delete 
-            if (cursorPosition < bytesRead) {
-                for (size_t i = cursorPosition; i < bytesRead - 1; i++) {
-                    buffer[i] = buffer[i + 1];
-                }
-                bytesRead--;
+            if (line->cursor < line->count) {
+                memmove(&buffer[line->cursor], &buffer[line->cursor + 1],
+                        line->count - line->cursor - 1);
+                line->count--;
+                echo_put(e, "\x1B[P", 3);
+            }
+            break;
 
-                redraw_from_position(dev, buffer, cursorPosition, bytesRead);
-                serial_out(dev, " ", 1);  // Clear the last character
-                move_cursor_left(dev, bytesRead - cursorPosition + 1);
+        default:
+            // Handle regular characters
+            if (ch >= ' ' && ch <= '~') {
+                memmove(&buffer[line->cursor + 1], &buffer[line->cursor],
+                        line->count - line->cursor);
+                buffer[line->cursor] = ch;
+                line->count++;
+                line->cursor++;
+
+                // Inside the line, open a gap for it (ICH) rather than redraw the tail
+                if (line->cursor < line->count) {
+                    echo_put(e, "\x1B[@", 3);
+                }
+                echo_put(e, &ch, 1);
             }
             break;
+    }
 
+    // Done once the buffer is full (-1 to leave space for null terminator)
+    if (line->count >= line->len - 1) {
+        history_add(h, buffer, line->count);
+        buffer[line->count] = '\0';
+        return 1;
+    }
+    return 0;
+}
 
-            // Add cases for arrow keys if needed (they often send multi-byte sequences)
+int serial_line_feed(struct serial_line *line, device dev, char ch)
+{
+    struct echo e = { .dev = dev, .n = 0 };
+    int slot = dev == CONSOLE ? CONSOLE_HISTORY : serial_devno(dev);
+    int done = line_edit(line, &histories[slot], &e, ch);
+    echo_flush(&e);
+    return done;
+}
 
-            default:
-                // Handle regular characters
-                if (ch >= ' ' && ch <= '~') {
-                    for (size_t i = bytesRead; i > cursorPosition; i--) {
-                        buffer[i] = buffer[i - 1];
-                    }
-                    buffer[cursorPosition] = ch;
-                    bytesRead++;
-                    cursorPosition++;
-                    // serial_out(dev, &ch, 1);  // Echo to user
-                    redraw_from_position(dev, buffer, cursorPosition - 1, bytesRead);
-                    move_cursor_left(dev, bytesRead - cursorPosition);  // Move cursor back
-        
-                }
-                break;
-        }
+int serial_poll(device dev, char *buffer, size_t len) {
+    struct serial_line line;
+    int dno = serial_devno(dev);
 
-        if (ch == '\n') {
-            break;  // Break on newline for command processing
+    if (dno == -1 || initialized[dno] == 0) {
+        return -1;
+    }
+    if (len < 2) {
+        if (len == 1) {
+            buffer[0] = '\0';
         }
+        return 0;
     }
 
-    buffer[bytesRead] = '\0';  // Null-terminate the string
-    return bytesRead;
+    serial_line_start(&line, buffer, len);
+    while (!serial_line_feed(&line, dev, serial_getc(dno)))  // Wait until data is available
+        ;
+    return line.count;
 }
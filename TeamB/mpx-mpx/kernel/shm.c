@@ -0,0 +1,129 @@
+#include <stdint.h>
+#include <mpx/shm.h>
+#include <mpx/vm.h>
+#include <pcb.h>
+#include <string.h>
+
+#define SLOT_ADDR(i)	(SHM_REGION_BASE + (uint32_t)(i) * SHM_SLOT_SIZE)
+
+struct shm_region {
+	char name[SHM_NAME_LEN + 1];
+	uint32_t size;
+	unsigned int attached;	// 0 means the slot is free
+};
+
+static struct shm_region regions[SHM_MAX_REGIONS];
+
+static int find(const char *name)
+{
+	for (int i = 0; i < SHM_MAX_REGIONS; i++) {
+		if (regions[i].attached != 0 && strcmp(regions[i].name, name) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void unmap_region(int i, uint32_t size)
+{
+	for (uint32_t off = 0; off < size; off += PAGE_SIZE) {
+		vm_unmap_page(SLOT_ADDR(i) + off);
+	}
+}
+
+/* Backs a free slot with zeroed frames, returns non-zero if memory ran out */
+static int create(int i, const char *name, size_t size)
+{
+	uint32_t bytes = (size + PAGE_SIZE - 1) & ~(uint32_t)(PAGE_SIZE - 1);
+	for (uint32_t off = 0; off < bytes; off += PAGE_SIZE) {
+		if (vm_map_page(SLOT_ADDR(i) + off) != 0) {
+			unmap_region(i, off);
+			return -1;
+		}
+	}
+	memset((void *)SLOT_ADDR(i), 0, bytes);
+
+	size_t len = strlen(name);
+	memcpy(regions[i].name, name, len);
+	regions[i].name[len] = '\0';
+	regions[i].size = bytes;
+	return 0;
+}
+
+/* Drops one reference, freeing the frames with the last */
+static void put(int i)
+{
+	if (--regions[i].attached == 0) {
+		unmap_region(i, regions[i].size);
+		regions[i].size = 0;
+	}
+}
+
+void *shm_attach(const char *name, size_t size)
+{
+	if (current_process == NULL || name == NULL ||
+	    strlen(name) > SHM_NAME_LEN || size > SHM_SLOT_SIZE) {
+		return NULL;
+	}
+	uint32_t *attached = &current_process->cold->shm_attached;
+
+	int i = find(name);
+	if (i >= 0) {
+		if (size > regions[i].size) {
+			return NULL;
+		}
+	} else {
+		if (size == 0) {
+			return NULL;
+		}
+		for (i = 0; i < SHM_MAX_REGIONS && regions[i].attached != 0; i++)
+			;
+		if (i == SHM_MAX_REGIONS || create(i, name, size) != 0) {
+			return NULL;
+		}
+	}
+
+	if (!(*attached & (1u << i))) {
+		*attached |= 1u << i;
+		regions[i].attached++;
+	}
+	return (void *)SLOT_ADDR(i);
+}
+
+int shm_detach(const char *name)
+{
+	if (current_process == NULL || name == NULL) {
+		return -1;
+	}
+	uint32_t *attached = &current_process->cold->shm_attached;
+
+	int i = find(name);
+	if (i < 0 || !(*attached & (1u << i))) {
+		return -1;
+	}
+	*attached &= ~(1u << i);
+	put(i);
+	return 0;
+}
+
+void shm_release(uint32_t *attached)
+{
+	for (int i = 0; *attached != 0; i++) {
+		if (*attached & (1u << i)) {
+			*attached &= ~(1u << i);
+			put(i);
+		}
+	}
+}
+
+int shm_get_info(unsigned int slot, struct shm_info *info)
+{
+	if (slot >= SHM_MAX_REGIONS || regions[slot].attached == 0) {
+		return -1;
+	}
+	info->name = regions[slot].name;
+	info->addr = (void *)SLOT_ADDR(slot);
+	info->size = regions[slot].size;
+	info->attached = regions[slot].attached;
+	return 0;
+}
@@ -0,0 +1,18 @@
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; Body of the page fault task. Page faults reach it through a task gate, so
+; it runs on its own stack even when the faulting process has run off the
+; mapped part of its stack and nothing more can be pushed there.
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+bits 32
+global page_fault_task
+
+extern stack_fault
+
+page_fault_task:
+	mov eax, cr2		;; faulting address
+	push eax		;; the CPU already pushed the error code
+	call stack_fault	;; stack_fault(address, error code)
+	add esp, 8		;; drop the address and the error code
+	iret			;; task return to the faulting process
+	jmp page_fault_task	;; the next fault resumes here
@@ -0,0 +1,295 @@
+#include <stdint.h>
+#include <mpx/gdt.h>
+#include <mpx/interrupts.h>
+#include <mpx/klog.h>
+#include <mpx/panic.h>
+#include <mpx/stack.h>
+#include <mpx/vm.h>
+#include <pcb.h>
+#include <spawn.h>
+#include <string.h>
+
+// size of the stack the page fault task runs on
+#define FAULT_STACK_SIZE	0x1000
+
+/* 32-bit Task State Segment */
+struct tss {
+	uint32_t link;
+	uint32_t esp0, ss0, esp1, ss1, esp2, ss2;
+	uint32_t cr3, eip, eflags;
+	uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+	uint32_t es, cs, ss, ds, fs, gs;
+	uint32_t ldt;
+	uint16_t trap;
+	uint16_t iomap_base;
+} __attribute__((packed));
+
+// whatever is running when a fault hits is saved here
+static struct tss kernel_tss;
+
+// the page fault task
+static struct tss fault_tss;
+static unsigned char fault_stack[FAULT_STACK_SIZE] __attribute__((aligned(16)));
+
+// a process that overflowed its stack makes its exit request on this one
+static unsigned char exit_stack[FAULT_STACK_SIZE] __attribute__((aligned(16)));
+
+// stacks by slot, so a fault address can be traced back to its stack
+static struct proc_stack *slots[STACK_SLOTS];
+
+/* A piece of a swapped-out stack, chained from the saved stack pointer up */
+struct stack_swap_block {
+	struct stack_swap_block *next;
+	unsigned char data[STACK_SWAP_BLOCK];
+};
+
+// swap blocks come from the kernel heap, which never frees, so keep them
+static struct stack_swap_block *free_blocks = NULL;
+static struct stack_swap_stats swap_stats;
+
+extern void page_fault_task(void);
+
+void stack_init(void)
+{
+	kernel_tss.iomap_base = sizeof(struct tss);
+	gdt_install_tss(GDT_KERNEL_TSS, &kernel_tss, sizeof(kernel_tss));
+
+	fault_tss.eip = (uint32_t)page_fault_task;
+	fault_tss.esp = (uint32_t)(fault_stack + FAULT_STACK_SIZE);
+	fault_tss.cs = 0x08;
+	fault_tss.ss = 0x10;
+	fault_tss.ds = 0x10;
+	fault_tss.es = 0x10;
+	fault_tss.fs = 0x10;
+	fault_tss.gs = 0x10;
+	fault_tss.eflags = 0x02;	// interrupts stay off while servicing
+	fault_tss.cr3 = vm_page_directory();
+	fault_tss.iomap_base = sizeof(struct tss);
+	gdt_install_tss(GDT_PAGE_FAULT_TSS, &fault_tss, sizeof(fault_tss));
+
+	// the first task switch needs somewhere to save the running state
+	__asm__ volatile ("ltr %%ax" :: "a"(GDT_KERNEL_TSS));
+	idt_install_task_gate(14, GDT_PAGE_FAULT_TSS);
+}
+
+/* Where a process that overflowed its stack resumes, to be ended */
+static void overflow_exit(void)
+{
+	process_exit(-1);
+}
+
+/*
+ Called by page_fault_task. Grows a stack down to the faulting page if the
+ fault is within the stack's limit, and ends the running process if it ran
+ past the limit of its own stack; anything else halts the system.
+*/
+void stack_fault(uint32_t addr, uint32_t error_code)
+{
+	// faults on present pages are protection faults, not growth
+	if (!(error_code & 0x1) && addr >= STACK_REGION_BASE &&
+	    addr < STACK_REGION_BASE + STACK_SLOTS * STACK_SLOT_SIZE) {
+		struct proc_stack *s = slots[(addr - STACK_REGION_BASE) / STACK_SLOT_SIZE];
+		if (s != NULL && addr < s->top) {
+			if (addr < s->top - s->limit) {
+				if (current_process == NULL || s != &current_process->cold->stack) {
+					kpanic("Stack overflow");
+				}
+				klog(KLOG_ERR, "stack", "Stack overflow: %s",
+				    current_process->cold->process_name);
+
+				// the task return resumes it there, interrupts off, instead
+				kernel_tss.eip = (uint32_t)overflow_exit;
+				kernel_tss.esp = (uint32_t)(exit_stack + FAULT_STACK_SIZE);
+				kernel_tss.eflags = 0x02;
+				return;
+			}
+
+			// the process may have skipped pages, so map everything in between
+			uint32_t page = addr & ~(PAGE_SIZE - 1);
+			uint32_t bottom = s->top - s->mapped;
+			for (uint32_t a = bottom - PAGE_SIZE; a >= page; a -= PAGE_SIZE) {
+				vm_map_page(a);
+			}
+			memset((void *)page, STACK_PAINT, bottom - page);
+			s->mapped = s->top - page;
+			return;
+		}
+	}
+
+	kpanic("Page Fault");
+}
+
+int stack_alloc(struct proc_stack *s, unsigned int slot, size_t limit)
+{
+	if (slot >= STACK_SLOTS) {
+		return -1;
+	}
+
+	limit = (limit + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+	if (limit < PAGE_SIZE) {
+		limit = PAGE_SIZE;
+	}
+	if (limit > STACK_MAX_LIMIT) {
+		limit = STACK_MAX_LIMIT;
+	}
+
+	// start with a single page; the rest is mapped on demand
+	s->top = STACK_REGION_BASE + (slot + 1) * STACK_SLOT_SIZE;
+	s->limit = limit;
+	s->mapped = PAGE_SIZE;
+	s->warned = 0;
+	s->peak = 0;
+	s->swapped = NULL;
+	if (vm_map_page(s->top - PAGE_SIZE) != 0) {
+		s->mapped = 0;
+		return -1;
+	}
+	memset((void *)(s->top - PAGE_SIZE), STACK_PAINT, PAGE_SIZE);
+
+	slots[slot] = s;
+	return 0;
+}
+
+size_t stack_peak(const struct proc_stack *s)
+{
+	const uint32_t *p = (const uint32_t *)(s->top - s->mapped);
+	const uint32_t *end = (const uint32_t *)s->top;
+	while (p < end && *p == STACK_PAINT_WORD) {
+		p++;
+	}
+
+	// painting below the live part does not survive a swap
+	size_t depth = (uintptr_t)end - (uintptr_t)p;
+	return depth > s->peak ? depth : s->peak;
+}
+
+int stack_near_limit(struct proc_stack *s)
+{
+	if (s->warned || s->mapped < s->limit / 8 * STACK_WARN_EIGHTHS) {
+		return 0;
+	}
+	s->warned = 1;
+	return 1;
+}
+
+static void unmap_range(uint32_t bottom, uint32_t top)
+{
+	for (uint32_t a = bottom; a < top; a += PAGE_SIZE) {
+		vm_unmap_page(a);
+	}
+}
+
+static struct stack_swap_block *block_get(void)
+{
+	struct stack_swap_block *b = free_blocks;
+	if (b != NULL) {
+		free_blocks = b->next;
+		return b;
+	}
+	return kmalloc(sizeof(struct stack_swap_block), 0, NULL);
+}
+
+/* Returns a chain of blocks to the free list, and how many there were */
+static unsigned int blocks_put(struct stack_swap_block *b)
+{
+	unsigned int n = 0;
+	while (b != NULL) {
+		struct stack_swap_block *next = b->next;
+		b->next = free_blocks;
+		free_blocks = b;
+		b = next;
+		n++;
+	}
+	return n;
+}
+
+int stack_swap_out(struct proc_stack *s, uint32_t sp)
+{
+	if (s->swapped != NULL || sp >= s->top || sp < s->top - s->mapped) {
+		return -1;
+	}
+
+	uint32_t live = s->top - sp;
+	struct stack_swap_block *head = NULL;
+	struct stack_swap_block **link = &head;
+	unsigned int blocks = 0;
+	for (uint32_t off = 0; off < live; off += STACK_SWAP_BLOCK) {
+		struct stack_swap_block *b = block_get();
+		if (b == NULL) {
+			blocks_put(head);
+			return -1;
+		}
+		uint32_t n = live - off < STACK_SWAP_BLOCK ? live - off : STACK_SWAP_BLOCK;
+		memcpy(b->data, (void *)(sp + off), n);
+		b->next = NULL;
+		*link = b;
+		link = &b->next;
+		blocks++;
+	}
+
+	s->peak = stack_peak(s);
+	s->live = live;
+	s->released = s->mapped;
+	s->swapped = head;
+	unmap_range(s->top - s->mapped, s->top);
+	s->mapped = 0;
+
+	swap_stats.stacks++;
+	swap_stats.released += s->released;
+	swap_stats.buffered += blocks * sizeof(struct stack_swap_block);
+	return 0;
+}
+
+int stack_swap_in(struct proc_stack *s)
+{
+	if (s->swapped == NULL) {
+		return 0;
+	}
+
+	uint32_t sp = s->top - s->live;
+	uint32_t bottom = sp & ~(PAGE_SIZE - 1);
+	for (uint32_t a = bottom; a < s->top; a += PAGE_SIZE) {
+		if (vm_map_page(a) != 0) {
+			unmap_range(bottom, a);
+			return -1;
+		}
+	}
+	s->mapped = s->top - bottom;
+	memset((void *)bottom, STACK_PAINT, sp - bottom);
+
+	uint32_t off = 0;
+	for (struct stack_swap_block *b = s->swapped; b != NULL; b = b->next) {
+		uint32_t n = s->live - off < STACK_SWAP_BLOCK ? s->live - off : STACK_SWAP_BLOCK;
+		memcpy((void *)(sp + off), b->data, n);
+		off += n;
+	}
+
+	unsigned int blocks = blocks_put(s->swapped);
+	s->swapped = NULL;
+	swap_stats.stacks--;
+	swap_stats.released -= s->released;
+	swap_stats.buffered -= blocks * sizeof(struct stack_swap_block);
+	return 0;
+}
+
+void stack_get_swap_stats(struct stack_swap_stats *stats)
+{
+	*stats = swap_stats;
+}
+
+void stack_free(struct proc_stack *s)
+{
+	if (s->swapped != NULL) {
+		unsigned int blocks = blocks_put(s->swapped);
+		s->swapped = NULL;
+		swap_stats.stacks--;
+		swap_stats.released -= s->released;
+		swap_stats.buffered -= blocks * sizeof(struct stack_swap_block);
+	} else if (s->mapped == 0) {
+		return;
+	}
+
+	unmap_range(s->top - s->mapped, s->top);
+	s->mapped = 0;
+	slots[(s->top - STACK_REGION_BASE) / STACK_SLOT_SIZE - 1] = NULL;
+}
@@ -2,6 +2,9 @@
 #include <pcb.h>
 #include <sys_req.h>
 #include <string.h>
+#include <mpx/serial.h>
+#include <mpx/dcb.h>
+#include <mpx/klog.h>
 
 struct pcb *current_process = NULL; 
 struct pcb *next_process = NULL;  
@@ -11,6 +14,11 @@ int insert_flag = 0;
 struct context *sys_call(struct context *ctx) {
 
     unsigned int operation = ctx->eax;
+    struct pcb *caller = current_process;  // sys_call() is running on this PCB's stack
+
+    // Finish whatever I/O the device interrupts made possible, readying its requesters
+    io_schedule();
+
     if (operation == IDLE) {
         if (initial_context == NULL) {  
             initial_context = ctx;
@@ -20,7 +28,7 @@ struct context *sys_call(struct context *ctx) {
         // set current_prcess to ready
         // set current_process -> stackptr = ctx;
         // insert current_process into ready queue
-        //ctx->eax = (uint32_t) 0;
+        ctx->eax = (uint32_t) 0;
         if (current_process != NULL) {
             current_process->execution_state = READY;
             current_process->stack_ptr = (unsigned char *) ctx;
@@ -30,14 +38,46 @@ struct context *sys_call(struct context *ctx) {
 
     else if (operation == EXIT) {
         // Handle EXIT
-        // Delete current_process
+        // Turn current_process into a zombie; the reaper frees it later
         // Load next process context or initial_context if no other process
         // Set return value in ctx->eax to 0
         if (current_process != NULL) {
-            pcb_remove(current_process); // Remove current_process from its queue
-            pcb_free(current_process); // Deallocate PCB resources
+            pcb_exit(current_process, (int) ctx->ebx);
             current_process = NULL;
         }
+    }
+
+    else if (operation == WAIT) {
+        // Handle WAIT
+        // ebx holds the pid of the child to wait for
+        // Return at once if it has exited or is not a child, else block
+        // current_process until pcb_exit() wakes it
+        int ret = current_process != NULL ? pcb_wait(current_process, (int) ctx->ebx) : -1;
+        ctx->eax = (uint32_t) (ret < 0 ? -1 : 0);
+        if (ret <= 0) {
+            return ctx;
+        }
+        current_process->execution_state = BLOCKED;
+        current_process->stack_ptr = (unsigned char *) ctx;
+        insert_flag = 1;
+    }
+
+    else if (operation == READ || operation == WRITE) {
+        // Handle READ and WRITE
+        // ebx, ecx and edx hold the device, buffer and length
+        // Return at once if the request completed, else block current_process
+        // until io_schedule() finishes it and stores the byte count in eax
+        // With no process to block, POLL_DEVICE makes sys_req() poll the port itself
+        int ret = current_process != NULL
+            ? io_request(current_process, operation, (device) ctx->ebx, (char *) ctx->ecx, (size_t) ctx->edx)
+            : POLL_DEVICE;
+        if (ret != IO_PENDING) {
+            ctx->eax = (uint32_t) ret;
+            return ctx;
+        }
+        current_process->execution_state = BLOCKED;
+        current_process->stack_ptr = (unsigned char *) ctx;
+        insert_flag = 1;
     } else {
         ctx->eax = (uint32_t) -1;  // Unsupported operation
         return ctx;
@@ -46,19 +86,37 @@ struct context *sys_call(struct context *ctx) {
     if (get_ready_q() != NULL && get_ready_q()->front != NULL) {
             next_process = get_ready_q()->front;
             ctx = (struct context *) next_process->stack_ptr;
-            pcb_remove(next_process); // Remove current_process from its queue
-            pcb_free(next_process); // Deallocate PCB resources
+            pcb_remove(next_process); // Remove next_process from the ready queue
+            if (stack_near_limit(&next_process->cold->stack)) {
+                // Warn once, while there is still room to raise the limit
+                klog(KLOG_WARN, "stack", "Stack near limit: %s", next_process->cold->process_name);
+            }
             if (insert_flag == 1) {
                 pcb_insert(current_process);
                 insert_flag = 0;
             }
             current_process = next_process;
     }
+    else if (insert_flag == 1 && current_process->execution_state == READY) {
+        // Nothing else is ready, so an idling process carries on
+        insert_flag = 0;
+    }
     else { // if no process, load initial context
+        if (insert_flag == 1) {
+            pcb_insert(current_process); // Blocked in WAIT or on I/O; keep it queued
+            insert_flag = 0;
+        }
+        current_process = NULL;
         ctx = initial_context;
         initial_context = NULL; // reset initial_context as it's now being used
     }
-    ctx->eax = (uint32_t) 0;
+
+    // Reap zombies in batches, or at idle time when only the idle process is left
+    if (pcb_zombie_count() >= REAP_BATCH
+        || (pcb_zombie_count() > 0 && (current_process == NULL
+            || current_process->process_priority == LOWEST_PRIORITY))) {
+        pcb_reap(caller);
+    }
 
     return ctx;
 }
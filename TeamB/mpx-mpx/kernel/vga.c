@@ -0,0 +1,321 @@
+#include <stdint.h>
+#include <mpx/io.h>
+#include <mpx/vga.h>
+#include <string.h>
+
+// Colour text-mode buffer, and the CRT controller registers holding the cursor
+#define VGA_MEMORY	0xB8000
+#define CRTC_INDEX	0x3D4
+#define CRTC_DATA	0x3D5
+#define CRTC_CURSOR_HI	0x0E
+#define CRTC_CURSOR_LO	0x0F
+
+// Light grey on black, as the BIOS leaves it
+#define DEFAULT_FG	7
+#define DEFAULT_BG	0
+
+// Most numbers kept from one escape sequence; more are ignored
+#define MAX_PARAMS	4
+
+enum escape_state {
+	NORMAL,
+	ESCAPE,		// after ESC
+	CSI,		// after ESC [, collecting parameters
+};
+
+static volatile uint16_t *const screen = (volatile uint16_t *)VGA_MEMORY;
+
+// ANSI colour numbers in the order the VGA palette has them
+static const uint8_t ansi_to_vga[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
+/* The cursor, the colours in use and any escape sequence in progress */
+static struct {
+	unsigned int row;
+	unsigned int col;	// VGA_COLS once the last column is written, until the next wraps
+	uint8_t fg;
+	uint8_t bg;
+	int bright;
+	int reverse;
+	enum escape_state state;
+	unsigned int params[MAX_PARAMS];
+	unsigned int nparams;
+	int private;		// a '?' sequence, which is read and ignored
+} term;
+
+static uint8_t attribute(void)
+{
+	uint8_t fg = term.fg | (term.bright ? 0x08 : 0);
+	uint8_t bg = term.bg;
+	return term.reverse ? (uint8_t)((fg << 4) | bg) : (uint8_t)((bg << 4) | fg);
+}
+
+static uint16_t blank(void)
+{
+	return (uint16_t)(attribute() << 8) | ' ';
+}
+
+/* Blanks the cells from index from up to, not including, index to */
+static void fill(unsigned int from, unsigned int to)
+{
+	uint16_t b = blank();
+	for (unsigned int i = from; i < to; i++) {
+		screen[i] = b;
+	}
+}
+
+static void line_feed(void)
+{
+	if (term.row + 1 < VGA_ROWS) {
+		term.row++;
+		return;
+	}
+	// video memory is plain RAM to the CPU, so one block move scrolls it
+	memmove((void *)screen, (const void *)(screen + VGA_COLS),
+	    (VGA_ROWS - 1) * VGA_COLS * sizeof(screen[0]));
+	fill((VGA_ROWS - 1) * VGA_COLS, VGA_ROWS * VGA_COLS);
+}
+
+static void put_char(char c)
+{
+	if (term.col == VGA_COLS) {
+		term.col = 0;
+		line_feed();
+	}
+	screen[term.row * VGA_COLS + term.col] = (uint16_t)(attribute() << 8) | (uint8_t)c;
+	term.col++;
+}
+
+/* The cursor column, with a pending wrap counted as the last column */
+static unsigned int column(void)
+{
+	return term.col < VGA_COLS ? term.col : VGA_COLS - 1;
+}
+
+/* Parameter i of the sequence, or def if it was left out or zero */
+static unsigned int param(unsigned int i, unsigned int def)
+{
+	return i < term.nparams && term.params[i] != 0 ? term.params[i] : def;
+}
+
+static void select_graphics(void)
+{
+	if (term.nparams == 0) {
+		term.nparams = 1;
+		term.params[0] = 0;
+	}
+	for (unsigned int i = 0; i < term.nparams; i++) {
+		unsigned int p = term.params[i];
+		if (p == 0) {
+			term.fg = DEFAULT_FG;
+			term.bg = DEFAULT_BG;
+			term.bright = 0;
+			term.reverse = 0;
+		} else if (p == 1) {
+			term.bright = 1;
+		} else if (p == 7) {
+			term.reverse = 1;
+		} else if (p == 22) {
+			term.bright = 0;
+		} else if (p == 27) {
+			term.reverse = 0;
+		} else if (p >= 30 && p <= 37) {
+			term.fg = ansi_to_vga[p - 30];
+		} else if (p == 39) {
+			term.fg = DEFAULT_FG;
+		} else if (p >= 40 && p <= 47) {
+			term.bg = ansi_to_vga[p - 40];
+		} else if (p == 49) {
+			term.bg = DEFAULT_BG;
+		}
+	}
+}
+
+/* Carries out a complete ESC [ sequence ending in final */
+static void control(char final)
+{
+	unsigned int line = term.row * VGA_COLS;
+	unsigned int col = column();
+	unsigned int n = param(0, 1);
+
+	switch (final) {
+	case 'A':
+		term.row = n < term.row ? term.row - n : 0;
+		term.col = col;
+		break;
+	case 'B':
+		term.row = term.row + n < VGA_ROWS ? term.row + n : VGA_ROWS - 1;
+		term.col = col;
+		break;
+	case 'C':
+		term.col = col + n < VGA_COLS ? col + n : VGA_COLS - 1;
+		break;
+	case 'D':
+		term.col = n < col ? col - n : 0;
+		break;
+	case 'H':
+	case 'f':
+		term.row = param(0, 1) < VGA_ROWS ? param(0, 1) - 1 : VGA_ROWS - 1;
+		term.col = param(1, 1) < VGA_COLS ? param(1, 1) - 1 : VGA_COLS - 1;
+		break;
+	case 'J':
+		switch (param(0, 0)) {
+		case 0:
+			fill(line + col, VGA_ROWS * VGA_COLS);
+			break;
+		case 1:
+			fill(0, line + col + 1);
+			break;
+		default:
+			fill(0, VGA_ROWS * VGA_COLS);
+			break;
+		}
+		break;
+	case 'K':
+		switch (param(0, 0)) {
+		case 0:
+			fill(line + col, line + VGA_COLS);
+			break;
+		case 1:
+			fill(line, line + col + 1);
+			break;
+		default:
+			fill(line, line + VGA_COLS);
+			break;
+		}
+		break;
+	case '@':
+		// shift the rest of the line right, losing what falls off the end
+		if (n > VGA_COLS - col) {
+			n = VGA_COLS - col;
+		}
+		memmove((void *)(screen + line + col + n), (const void *)(screen + line + col),
+		    (VGA_COLS - col - n) * sizeof(screen[0]));
+		fill(line + col, line + col + n);
+		term.col = col;
+		break;
+	case 'P':
+		// shift the rest of the line left, blanking the end
+		if (n > VGA_COLS - col) {
+			n = VGA_COLS - col;
+		}
+		memmove((void *)(screen + line + col), (const void *)(screen + line + col + n),
+		    (VGA_COLS - col - n) * sizeof(screen[0]));
+		fill(line + VGA_COLS - n, line + VGA_COLS);
+		term.col = col;
+		break;
+	case 'm':
+		select_graphics();
+		break;
+	default:
+		break;
+	}
+}
+
+static void feed(char c)
+{
+	if (term.state == ESCAPE) {
+		if (c == '[') {
+			term.state = CSI;
+			term.nparams = 0;
+			term.private = 0;
+		} else {
+			term.state = NORMAL;
+		}
+		return;
+	}
+
+	if (term.state == CSI) {
+		if (c >= '0' && c <= '9') {
+			if (term.nparams == 0) {
+				term.nparams = 1;
+				term.params[0] = 0;
+			}
+			if (term.nparams <= MAX_PARAMS) {
+				unsigned int *p = &term.params[term.nparams - 1];
+				*p = *p * 10 + (unsigned int)(c - '0');
+			}
+		} else if (c == ';') {
+			if (term.nparams == 0) {
+				term.nparams = 1;
+				term.params[0] = 0;
+			}
+			if (term.nparams < MAX_PARAMS) {
+				term.params[term.nparams] = 0;
+			}
+			term.nparams++;
+		} else if (c >= 0x3C && c <= 0x3F) {
+			term.private = 1;
+		} else if (c >= 0x40 && c <= 0x7E) {
+			if (term.nparams > MAX_PARAMS) {
+				term.nparams = MAX_PARAMS;
+			}
+			if (!term.private) {
+				control(c);
+			}
+			term.state = NORMAL;
+		}
+		return;
+	}
+
+	switch (c) {
+	case '\x1B':
+		term.state = ESCAPE;
+		break;
+	case '\r':
+		term.col = 0;
+		break;
+	case '\n':
+		// like a tty that turns newlines into CR LF
+		term.col = 0;
+		line_feed();
+		break;
+	case '\b':
+		term.col = column();
+		if (term.col > 0) {
+			term.col--;
+		}
+		break;
+	case '\t':
+		do {
+			put_char(' ');
+		} while (term.col % 8 != 0 && term.col < VGA_COLS);
+		break;
+	default:
+		if ((unsigned char)c >= ' ' && c != 0x7F) {
+			put_char(c);
+		}
+		break;
+	}
+}
+
+static void move_cursor(void)
+{
+	uint16_t pos = (uint16_t)(term.row * VGA_COLS + column());
+	outb(CRTC_INDEX, CRTC_CURSOR_HI);
+	outb(CRTC_DATA, pos >> 8);
+	outb(CRTC_INDEX, CRTC_CURSOR_LO);
+	outb(CRTC_DATA, pos & 0xFF);
+}
+
+void vga_init(void)
+{
+	term.row = 0;
+	term.col = 0;
+	term.fg = DEFAULT_FG;
+	term.bg = DEFAULT_BG;
+	term.bright = 0;
+	term.reverse = 0;
+	term.state = NORMAL;
+	fill(0, VGA_ROWS * VGA_COLS);
+	move_cursor();
+}
+
+int vga_write(const char *buffer, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		feed(buffer[i]);
+	}
+	// the CRT controller is reached through slow port I/O, so once per write
+	move_cursor();
+	return (int)len;
+}
@@ -0,0 +1,287 @@
+#include <stdint.h>
+#include <mpx/io.h>
+#include <mpx/serial.h>
+#include <mpx/xfer.h>
+#include <sys_req.h>
+#include <string.h>
+
+// PIT channel 2, gated through the speaker port, times the TSC once
+#define PIT_CH2		0x42
+#define PIT_CMD		0x43
+#define PIT_GATE	0x61
+#define PIT_HZ		1193182
+#define CALIBRATE_MS	10
+
+struct frame {
+	uint8_t type;
+	uint8_t seq;
+	uint16_t len;
+	uint8_t payload[XFER_MAX_PAYLOAD];
+};
+
+static uint32_t crc_table[256];
+static int crc_ready = 0;
+
+static void crc_init(void)
+{
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++) {
+			c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		}
+		crc_table[n] = c;
+	}
+	crc_ready = 1;
+}
+
+uint32_t xfer_crc32(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	if (!crc_ready) {
+		crc_init();
+	}
+	crc = ~crc;
+	while (len-- > 0) {
+		crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static inline uint64_t rdtsc(void)
+{
+	uint32_t lo, hi;
+	__asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static uint64_t cycles_per_ms = 0;
+
+/* Counts TSC cycles over a one-shot countdown of PIT channel 2 */
+static void calibrate(void)
+{
+	uint16_t count = PIT_HZ * CALIBRATE_MS / 1000;
+	uint8_t gate = inb(PIT_GATE);
+	outb(PIT_GATE, (gate & ~0x02) | 0x01);	// gate on, speaker off
+	outb(PIT_CMD, 0xB0);			// channel 2, both bytes, mode 0
+	outb(PIT_CH2, count & 0xFF);
+	outb(PIT_CH2, count >> 8);
+	uint64_t start = rdtsc();
+	while (!(inb(PIT_GATE) & 0x20))		// OUT2 rises at terminal count
+		;
+	// a 32-bit span is plenty for 10 ms, and keeps the division off libgcc
+	cycles_per_ms = (uint32_t)(rdtsc() - start) / CALIBRATE_MS;
+	outb(PIT_GATE, gate);
+	if (cycles_per_ms == 0) {
+		cycles_per_ms = 1;
+	}
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Puts bytes in the transmit ring, letting other processes run while it is full */
+static void queue(device dev, const void *data, size_t len)
+{
+	const char *p = data;
+	while (len > 0) {
+		int n = serial_write(dev, p, len);
+		if (n < 0) {
+			return;
+		}
+		p += n;
+		len -= n;
+		if (len > 0) {
+			sys_req(IDLE);
+		}
+	}
+}
+
+static void send_frame(device dev, uint8_t type, uint8_t seq, const void *payload, uint16_t len)
+{
+	uint8_t head[6] = { XFER_MAGIC0, XFER_MAGIC1, type, seq, len & 0xFF, len >> 8 };
+	uint8_t tail[4];
+	put32(tail, xfer_crc32(xfer_crc32(0, head + 2, 4), payload, len));
+	queue(dev, head, sizeof(head));
+	queue(dev, payload, len);
+	queue(dev, tail, sizeof(tail));
+
+	// the other end can't answer before it has the frame, so the wait for
+	// a reply only starts once the frame has left the ring
+	int room;
+	while ((room = serial_tx_room(dev)) >= 0 && room < SERIAL_RING_SIZE) {
+		sys_req(IDLE);
+	}
+}
+
+/* Waits up to XFER_TIMEOUT_MS for a received byte, letting other processes
+   run. The wait restarts with every byte, so long frames at slow rates fit. */
+static int recv_byte(device dev, uint8_t *c)
+{
+	if (cycles_per_ms == 0) {
+		calibrate();
+	}
+	uint64_t deadline = rdtsc() + XFER_TIMEOUT_MS * cycles_per_ms;
+	while (serial_read(dev, (char *)c, 1) != 1) {
+		if (rdtsc() > deadline) {
+			return 0;
+		}
+		sys_req(IDLE);
+	}
+	return 1;
+}
+
+static int recv_bytes(device dev, uint8_t *p, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (!recv_byte(dev, &p[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Reads the next frame: 1 if it is intact, 0 on a timeout, -1 if damaged */
+static int recv_frame(device dev, struct frame *f)
+{
+	uint8_t c = 0, prev;
+	do {
+		prev = c;
+		if (!recv_byte(dev, &c)) {
+			return 0;
+		}
+	} while (prev != XFER_MAGIC0 || c != XFER_MAGIC1);
+
+	uint8_t head[4], tail[4];
+	if (!recv_bytes(dev, head, sizeof(head))) {
+		return 0;
+	}
+	f->type = head[0];
+	f->seq = head[1];
+	f->len = head[2] | (head[3] << 8);
+	if (f->len > XFER_MAX_PAYLOAD) {
+		return -1;
+	}
+	if (!recv_bytes(dev, f->payload, f->len)
+	    || !recv_bytes(dev, tail, sizeof(tail))) {
+		return 0;
+	}
+	return get32(tail) == xfer_crc32(xfer_crc32(0, head, 4), f->payload, f->len) ? 1 : -1;
+}
+
+/* Sends a frame until it is acknowledged */
+static int send_acked(device dev, uint8_t type, uint8_t seq, const void *payload,
+    uint16_t len, int tries)
+{
+	struct frame reply;
+	while (tries-- > 0) {
+		send_frame(dev, type, seq, payload, len);
+		int r = recv_frame(dev, &reply);
+		if (r == 1 && reply.type == XFER_ABORT) {
+			return -1;
+		}
+		if (r == 1 && reply.type == XFER_ACK && reply.seq == seq) {
+			return 0;
+		}
+	}
+	send_frame(dev, XFER_ABORT, seq, NULL, 0);
+	return -1;
+}
+
+int xfer_send(device dev, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint8_t seq = 0;
+	uint8_t word[4];
+
+	put32(word, len);
+	if (send_acked(dev, XFER_START, seq++, word, sizeof(word), XFER_START_TRIES) != 0) {
+		return -1;
+	}
+	for (size_t done = 0; done < len; seq++) {
+		uint16_t n = len - done < XFER_MAX_PAYLOAD ? len - done : XFER_MAX_PAYLOAD;
+		if (send_acked(dev, XFER_DATA, seq, p + done, n, XFER_RETRIES) != 0) {
+			return -1;
+		}
+		done += n;
+	}
+	put32(word, xfer_crc32(0, data, len));
+	return send_acked(dev, XFER_END, seq, word, sizeof(word), XFER_RETRIES);
+}
+
+int xfer_recv(device dev, void *buffer, size_t size, size_t *received)
+{
+	struct frame f;
+	uint8_t expect = 0;	// wraps on blobs over 255 frames
+	int started = 0;
+	size_t total = 0, got = 0;
+	int timeouts = 0;
+
+	for (;;) {
+		int r = recv_frame(dev, &f);
+		if (r == 0) {
+			// the sender resends on its own; only a silent one is given up on
+			if (++timeouts > (started ? XFER_RETRIES : XFER_START_TRIES)) {
+				send_frame(dev, XFER_ABORT, expect, NULL, 0);
+				return -1;
+			}
+			continue;
+		}
+		timeouts = 0;
+		if (r < 0) {
+			send_frame(dev, XFER_NAK, expect, NULL, 0);
+			continue;
+		}
+		if (f.type == XFER_ABORT) {
+			return -1;
+		}
+		if (started && f.seq == (uint8_t)(expect - 1)) {
+			// our ACK was lost, so the sender repeated itself
+			send_frame(dev, XFER_ACK, f.seq, NULL, 0);
+			continue;
+		}
+		if (f.seq != expect) {
+			send_frame(dev, XFER_NAK, expect, NULL, 0);
+			continue;
+		}
+
+		if (f.type == XFER_START && !started && f.len == 4) {
+			total = get32(f.payload);
+			if (total > size) {
+				send_frame(dev, XFER_ABORT, f.seq, NULL, 0);
+				return -2;
+			}
+			started = 1;
+		} else if (f.type == XFER_DATA && started && got + f.len <= total) {
+			memcpy((uint8_t *)buffer + got, f.payload, f.len);
+			got += f.len;
+		} else if (f.type == XFER_END && started && f.len == 4) {
+			if (got != total || get32(f.payload) != xfer_crc32(0, buffer, got)) {
+				send_frame(dev, XFER_ABORT, f.seq, NULL, 0);
+				return -1;
+			}
+			send_frame(dev, XFER_ACK, f.seq, NULL, 0);
+			*received = got;
+
+			// if that ACK is lost the sender repeats END; answer it once more
+			if (recv_frame(dev, &f) == 1 && f.type == XFER_END) {
+				send_frame(dev, XFER_ACK, f.seq, NULL, 0);
+			}
+			return 0;
+		} else {
+			send_frame(dev, XFER_ABORT, f.seq, NULL, 0);
+			return -1;
+		}
+		send_frame(dev, XFER_ACK, f.seq, NULL, 0);
+		expect++;
+	}
+}
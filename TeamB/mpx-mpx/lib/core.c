@@ -9,20 +9,85 @@
 #include <mpx/vm.h>
 
 #include <memory.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys_req.h>
+
+/* Below this many bytes the string instructions cost more than a plain loop */
+#define REP_THRESHOLD 16
+
+/* Word access to memory of any type */
+typedef uint32_t __attribute__((may_alias)) word_t;
 
 /* For R5: Pointers to student provided functions */
 /* DO NOT SET MANUALLY, CALL sys_set_heap_functions() !!! */
 static void * (*malloc_function)(size_t) = NULL;
 static int (*free_function)(void *) = NULL;
 
+/* Allocation trace ring; once full, the oldest entries are overwritten */
+static struct alloc_trace_entry trace[ALLOC_TRACE_SIZE];
+static uint32_t trace_next = 0;		// total operations recorded
+static int trace_on = 0;
+
+static void trace_record(char op, size_t size, void *ptr)
+{
+	uint32_t lo, hi;
+	__asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+	(void)hi;
+
+	struct alloc_trace_entry *e = &trace[trace_next % ALLOC_TRACE_SIZE];
+	e->timestamp = lo;
+	e->size = (uint32_t)size;
+	e->ptr = (uint32_t)ptr;
+	e->op = op;
+	trace_next++;
+}
+
+/* Copies forwards: bytes up to an aligned destination, then whole words */
+static void copy_forward(unsigned char *dst, const unsigned char *src, size_t n)
+{
+	if (n >= REP_THRESHOLD) {
+		size_t head = -(uintptr_t)dst & 3;
+		n -= head;
+		__asm__ volatile ("rep movsb" : "+D"(dst), "+S"(src), "+c"(head) :: "memory");
+		size_t words = n / 4;
+		__asm__ volatile ("rep movsl" : "+D"(dst), "+S"(src), "+c"(words) :: "memory");
+		n &= 3;
+	}
+	__asm__ volatile ("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) :: "memory");
+}
+
 /* Standard memcpy() - required because compiler may insert calls to it */
 void *memcpy(void * restrict s1, const void * restrict s2, size_t n)
+{
+	copy_forward(s1, s2, n);
+	return s1;
+}
+
+/* Standard memmove() - required because compiler may insert calls to it */
+void *memmove(void *s1, const void *s2, size_t n)
 {
 	unsigned char *dst = s1;
 	const unsigned char *src = s2;
-	for (size_t i = 0; i < n; i++) {
-		dst[i] = src[i];
+
+	if (dst <= src || dst >= src + n) {
+		copy_forward(dst, src, n);
+		return s1;
+	}
+
+	// dst overlaps the end of src, so copy down from the top with DF set
+	size_t tail = n & 3;
+	while (tail-- > 0) {
+		n--;
+		dst[n] = src[n];
+	}
+	if (n > 0) {
+		unsigned char *d = dst + n - 4;
+		const unsigned char *s = src + n - 4;
+		size_t words = n / 4;
+		__asm__ volatile ("std\n\trep movsl\n\tcld"
+				  : "+D"(d), "+S"(s), "+c"(words) :: "memory");
 	}
 	return s1;
 }
@@ -31,12 +96,41 @@ void *memcpy(void * restrict s1, const void * restrict s2, size_t n)
 void *memset(void *s, int c, size_t n)
 {
 	unsigned char *p = s;
-	for (size_t i = 0; i < n; i++) {
-		p[i] = (unsigned char)c;
+	uint32_t byte = (unsigned char)c;
+
+	if (n >= REP_THRESHOLD) {
+		size_t head = -(uintptr_t)p & 3;
+		n -= head;
+		__asm__ volatile ("rep stosb" : "+D"(p), "+c"(head) : "a"(byte) : "memory");
+		size_t words = n / 4;
+		__asm__ volatile ("rep stosl" : "+D"(p), "+c"(words)
+				  : "a"(byte * 0x01010101) : "memory");
+		n &= 3;
 	}
+	__asm__ volatile ("rep stosb" : "+D"(p), "+c"(n) : "a"(byte) : "memory");
 	return s;
 }
 
+/* Standard memcmp() - required because compiler may insert calls to it */
+int memcmp(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *a = s1;
+	const unsigned char *b = s2;
+
+	// skip equal words, then find the differing byte
+	while (n >= 4 && *(const word_t *)a == *(const word_t *)b) {
+		a += 4;
+		b += 4;
+		n -= 4;
+	}
+	for (; n > 0; a++, b++, n--) {
+		if (*a != *b) {
+			return *a - *b;
+		}
+	}
+	return 0;
+}
+
 /***********************************************************************/
 /* This causes R5 to go into full effect, replacing default heap functions
  * with those implemented by students. */
@@ -50,11 +144,94 @@ void sys_set_heap_functions(void * (*alloc_fn)(size_t), int (*free_fn)(void *))
 /* Allocate memory using the student function if available, fallback to kmalloc(). */
 void *sys_alloc_mem(size_t size)
 {
-	return malloc_function ? malloc_function(size) : kmalloc(size, 0, NULL);
+	void *ptr = malloc_function ? malloc_function(size) : kmalloc(size, 0, NULL);
+	if (trace_on) {
+		trace_record(ALLOC_TRACE_ALLOC, size, ptr);
+	}
+	return ptr;
 }
 
 /* Free memory if a student function is available, otherwise NOP. */
 int sys_free_mem(void *ptr)
 {
+	if (trace_on) {
+		trace_record(ALLOC_TRACE_FREE, 0, ptr);
+	}
 	return free_function ? free_function(ptr) : -1;
 }
+
+void sys_alloc_trace(int enable)
+{
+	if (enable && !trace_on) {
+		trace_next = 0;
+	}
+	trace_on = enable;
+}
+
+unsigned int sys_alloc_trace_copy(struct alloc_trace_entry *out, unsigned int max)
+{
+	uint32_t first = trace_next > ALLOC_TRACE_SIZE ? trace_next - ALLOC_TRACE_SIZE : 0;
+	unsigned int n = 0;
+	for (uint32_t i = first; i < trace_next && n < max; i++) {
+		out[n++] = trace[i % ALLOC_TRACE_SIZE];
+	}
+	return n;
+}
+
+/* Text waiting to be written by sys_alloc_trace_dump() */
+struct dump_buffer {
+	device dev;
+	size_t len;
+	char data[256];
+};
+
+static void dump_flush(struct dump_buffer *b)
+{
+	if (b->len > 0) {
+		sys_req(WRITE, b->dev, b->data, b->len);
+		b->len = 0;
+	}
+}
+
+static void dump_text(struct dump_buffer *b, const char *text, size_t len)
+{
+	if (b->len + len > sizeof(b->data)) {
+		dump_flush(b);
+	}
+	memcpy(b->data + b->len, text, len);
+	b->len += len;
+}
+
+static void dump_number(struct dump_buffer *b, uint32_t value, int base)
+{
+	char num[12];
+	itoa((int)value, num, base);
+	dump_text(b, num, strlen(num));
+}
+
+void sys_alloc_trace_dump(device dev)
+{
+	uint32_t first = trace_next > ALLOC_TRACE_SIZE ? trace_next - ALLOC_TRACE_SIZE : 0;
+	struct dump_buffer b = { .dev = dev, .len = 0 };
+
+	// the header tells the replay tool whether the start of the trace was lost
+	dump_text(&b, "# alloc trace ", 14);
+	dump_number(&b, trace_next - first, 10);
+	dump_text(&b, " dropped ", 9);
+	dump_number(&b, first, 10);
+	dump_text(&b, "\r\n", 2);
+
+	for (uint32_t i = first; i < trace_next; i++) {
+		const struct alloc_trace_entry *e = &trace[i % ALLOC_TRACE_SIZE];
+		dump_text(&b, &e->op, 1);
+		dump_text(&b, " ", 1);
+		dump_number(&b, e->timestamp, 16);
+		dump_text(&b, " ", 1);
+		dump_number(&b, e->size, 16);
+		dump_text(&b, " ", 1);
+		dump_number(&b, e->ptr, 16);
+		dump_text(&b, "\r\n", 2);
+	}
+	dump_text(&b, "# end\r\n", 7);
+	dump_flush(&b);
+}
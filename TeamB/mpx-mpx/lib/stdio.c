@@ -0,0 +1,280 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pcb.h>
+#include <sys_req.h>
+
+/* Where formatted output goes: a bounded buffer, flushed if a flush is set */
+struct sink {
+	char *buf;
+	size_t cap;
+	size_t *len;
+	int (*flush)(void);
+	int newline;		// a newline went into the buffer
+	size_t total;		// bytes formatted, whether stored or not
+};
+
+// printf() buffer used before any process is running
+static struct print_buffer kernel_buffer;
+
+static struct print_buffer *print_buffer(void)
+{
+	return current_process != NULL ? &current_process->cold->out : &kernel_buffer;
+}
+
+static void put(struct sink *k, const char *s, size_t n)
+{
+	k->total += n;
+	while (n > 0) {
+		if (*k->len == k->cap) {
+			if (k->flush == NULL || k->flush() != 0) {
+				return;		// truncate
+			}
+		}
+		size_t room = k->cap - *k->len;
+		size_t m = n < room ? n : room;
+		memcpy(k->buf + *k->len, s, m);
+		*k->len += m;
+		s += m;
+		n -= m;
+	}
+}
+
+static void pad(struct sink *k, char c, int count)
+{
+	char run[16];
+	memset(run, c, sizeof(run));
+	while (count > 0) {
+		int m = count < (int)sizeof(run) ? count : (int)sizeof(run);
+		put(k, run, m);
+		count -= m;
+	}
+}
+
+/* Puts s, padded to width on the left, or on the right if left is set */
+static void field(struct sink *k, const char *s, size_t n, int width, int left, char fill)
+{
+	int gap = width > (int)n ? width - (int)n : 0;
+	if (!left) {
+		// zero padding goes after the sign
+		if (fill == '0' && n > 0 && *s == '-') {
+			put(k, s, 1);
+			s++;
+			n--;
+		}
+		pad(k, fill, gap);
+	}
+	put(k, s, n);
+	if (left) {
+		pad(k, ' ', gap);
+	}
+}
+
+/* Divides u by base in place and returns the remainder. It goes 16 bits at
+   a time, as there is no library to do 64-bit division. */
+static unsigned divide(uint64_t *u, unsigned base)
+{
+	uint32_t hi = (uint32_t)(*u >> 32);
+	uint32_t lo = (uint32_t)*u;
+	uint32_t q_hi = hi / base;
+	uint32_t part = (hi % base) << 16 | lo >> 16;
+	uint32_t q_mid = part / base;
+	part = (part % base) << 16 | (lo & 0xFFFF);
+	*u = (uint64_t)q_hi << 32 | q_mid << 16 | part / base;
+	return part % base;
+}
+
+static size_t number(char *out, uint64_t u, unsigned base, int upper, int negative)
+{
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char tmp[24];
+	size_t n = 0, i = 0;
+
+	while (u >> 32 != 0) {
+		tmp[n++] = digits[divide(&u, base)];
+	}
+	uint32_t v = (uint32_t)u;
+	do {
+		tmp[n++] = digits[v % base];
+		v /= base;
+	} while (v != 0);
+
+	if (negative) {
+		out[i++] = '-';
+	}
+	while (n > 0) {
+		out[i++] = tmp[--n];
+	}
+	return i;
+}
+
+static void format(struct sink *k, const char *fmt, va_list ap)
+{
+	while (*fmt != '\0') {
+		// copy the literal run up to the next conversion in one go
+		const char *run = fmt;
+		while (*fmt != '\0' && *fmt != '%') {
+			if (*fmt == '\n') {
+				k->newline = 1;
+			}
+			fmt++;
+		}
+		put(k, run, fmt - run);
+		if (*fmt == '\0') {
+			break;
+		}
+		const char *spec = fmt++;
+
+		int left = 0, width = 0, precision = -1;
+		char fill = ' ';
+		for (;; fmt++) {
+			if (*fmt == '-') {
+				left = 1;
+			} else if (*fmt == '0') {
+				fill = '0';
+			} else {
+				break;
+			}
+		}
+		if (*fmt == '*') {
+			width = va_arg(ap, int);
+			if (width < 0) {
+				left = 1;
+				width = -width;
+			}
+			fmt++;
+		}
+		while (*fmt >= '0' && *fmt <= '9') {
+			width = width * 10 + (*fmt++ - '0');
+		}
+		if (*fmt == '.') {
+			fmt++;
+			precision = 0;
+			if (*fmt == '*') {
+				precision = va_arg(ap, int);
+				fmt++;
+			}
+			while (*fmt >= '0' && *fmt <= '9') {
+				precision = precision * 10 + (*fmt++ - '0');
+			}
+		}
+		// only ll changes the size; long and size_t are 32 bits already
+		int longs = 0;
+		while (*fmt == 'l' || *fmt == 'h' || *fmt == 'z') {
+			longs += *fmt++ == 'l';
+		}
+		int wide = longs >= 2;
+
+		char num[24];
+		size_t n;
+		switch (*fmt) {
+		case 'd':
+		case 'i': {
+			int64_t v = wide ? va_arg(ap, int64_t) : va_arg(ap, int);
+			n = number(num, v < 0 ? -(uint64_t)v : (uint64_t)v, 10, 0, v < 0);
+			field(k, num, n, width, left, fill);
+			break;
+		}
+		case 'u':
+			n = number(num, wide ? va_arg(ap, uint64_t) : va_arg(ap, unsigned), 10, 0, 0);
+			field(k, num, n, width, left, fill);
+			break;
+		case 'x':
+		case 'X':
+			n = number(num, wide ? va_arg(ap, uint64_t) : va_arg(ap, unsigned), 16, *fmt == 'X', 0);
+			field(k, num, n, width, left, fill);
+			break;
+		case 'o':
+			n = number(num, wide ? va_arg(ap, uint64_t) : va_arg(ap, unsigned), 8, 0, 0);
+			field(k, num, n, width, left, fill);
+			break;
+		case 'p':
+			put(k, "0x", 2);
+			n = number(num, (uint32_t)(uintptr_t)va_arg(ap, void *), 16, 0, 0);
+			pad(k, '0', 8 - (int)n);
+			put(k, num, n);
+			break;
+		case 'c':
+			num[0] = (char)va_arg(ap, int);
+			field(k, num, 1, width, left, ' ');
+			break;
+		case 's': {
+			const char *s = va_arg(ap, const char *);
+			if (s == NULL) {
+				s = "(null)";
+			}
+			size_t len = 0;
+			if (precision < 0) {
+				len = strlen(s);
+			} else {
+				while (len < (size_t)precision && s[len] != '\0') {
+					len++;
+				}
+			}
+			for (size_t i = 0; i < len && !k->newline; i++) {
+				k->newline = s[i] == '\n';
+			}
+			field(k, s, len, width, left, ' ');
+			break;
+		}
+		case '%':
+			put(k, "%", 1);
+			break;
+		case '\0':
+			return;
+		default:
+			// not a conversion; show it as written, flags and all
+			put(k, spec, fmt - spec + 1);
+			break;
+		}
+		fmt++;
+	}
+}
+
+int vsnprintf(char *s, size_t n, const char *fmt, va_list ap)
+{
+	size_t len = 0;
+	struct sink k = {s, n > 0 ? n - 1 : 0, &len, NULL, 0, 0};
+	format(&k, fmt, ap);
+	if (n > 0) {
+		s[len] = '\0';
+	}
+	return (int)k.total;
+}
+
+int snprintf(char *s, size_t n, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	int ret = vsnprintf(s, n, fmt, ap);
+	va_end(ap);
+	return ret;
+}
+
+int printf_flush(void)
+{
+	struct print_buffer *b = print_buffer();
+	if (b->len == 0) {
+		return 0;
+	}
+	int ret = sys_req(WRITE, current_console(), b->data, b->len);
+	b->len = 0;
+	return ret < 0 ? ret : 0;
+}
+
+int printf(const char *fmt, ...)
+{
+	struct print_buffer *b = print_buffer();
+	struct sink k = {b->data, sizeof(b->data), &b->len, printf_flush, 0, 0};
+
+	va_list ap;
+	va_start(ap, fmt);
+	format(&k, fmt, ap);
+	va_end(ap);
+
+	if (k.newline) {
+		printf_flush();
+	}
+	return (int)k.total;
+}
@@ -27,3 +27,33 @@ int atoi(const char *s)
 
 	return res;
 }
+
+char *itoa(int value, char *s, int base)
+{
+	char digits[33];
+	int n = 0;
+	int i = 0;
+	unsigned int u = (unsigned int)value;
+
+	if (base < 2 || base > 16) {
+		s[0] = '\0';
+		return s;
+	}
+
+	if (value < 0 && base == 10) {
+		s[i++] = '-';
+		u = -u;
+	}
+
+	do {
+		digits[n++] = "0123456789abcdef"[u % base];
+		u /= base;
+	} while (u != 0);
+
+	while (n > 0) {
+		s[i++] = digits[--n];
+	}
+	s[i] = '\0';
+
+	return s;
+}
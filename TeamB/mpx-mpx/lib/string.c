@@ -1,9 +1,36 @@
+#include <stdint.h>
 #include <string.h>
 
-/* memcpy() and memset() are in core.c */
+/* memcpy(), memmove(), memset() and memcmp() are in core.c */
+
+/* Word access to memory of any type */
+typedef uint32_t __attribute__((may_alias)) word_t;
+
+/* Non-zero if any byte of w is zero */
+#define HAS_ZERO(w)	(((w) - 0x01010101) & ~(w) & 0x80808080)
+
+/*
+ Word loops only read aligned words, which never cross into the next page,
+ so they cannot fault past the end of a string.
+*/
 
 int strcmp(const char *s1, const char *s2)
 {
+	// with equal alignment, both strings can be walked a word at a time
+	if (((uintptr_t)s1 & 3) == ((uintptr_t)s2 & 3)) {
+		while (((uintptr_t)s1 & 3) != 0) {
+			if (*s1 == '\0' || *s1 != *s2) {
+				return (*(unsigned char *)s1 - *(unsigned char *)s2);
+			}
+			++s1;
+			++s2;
+		}
+		while (*(const word_t *)s1 == *(const word_t *)s2 &&
+		       !HAS_ZERO(*(const word_t *)s1)) {
+			s1 += 4;
+			s2 += 4;
+		}
+	}
 
 	// Remarks:
 	// 1) If we made it to the end of both strings (i. e. our pointer points to a
@@ -20,11 +47,20 @@ int strcmp(const char *s1, const char *s2)
 
 size_t strlen(const char *s)
 {
-	size_t len = 0;
-	while (*s++) {
-		len++;
+	const char *p = s;
+	while (((uintptr_t)p & 3) != 0) {
+		if (*p == '\0') {
+			return p - s;
+		}
+		++p;
+	}
+	while (!HAS_ZERO(*(const word_t *)p)) {
+		p += 4;
+	}
+	while (*p) {
+		++p;
 	}
-	return len;
+	return p - s;
 }
 
 char *strtok(char * restrict s1, const char * restrict s2)
@@ -1,23 +1,74 @@
 .POSIX:
 
 kernel/serial.o: kernel/serial.c include/mpx/io.h include/mpx/serial.h \
-  include/mpx/device.h include/sys_req.h
+  include/mpx/device.h include/mpx/interrupts.h include/sys_req.h \
+  include/string.h include/stdio.h include/mpx/klog.h include/mpx/vga.h
 
 kernel/kmain.o: kernel/kmain.c include/mpx/gdt.h include/mpx/interrupts.h \
   include/mpx/serial.h include/mpx/device.h include/mpx/vm.h \
-  include/sys_req.h include/string.h include/memory.h
+  include/mpx/multiboot.h include/mpx/arena.h include/mpx/stack.h \
+  include/mpx/dcb.h include/sys_req.h include/string.h include/stdio.h \
+  include/memory.h include/mpx/klog.h include/mpx/ata.h include/mpx/bcache.h
 
 kernel/core-c.o: kernel/core-c.c include/mpx/gdt.h include/mpx/panic.h \
   include/mpx/interrupts.h include/mpx/io.h include/mpx/serial.h \
   include/mpx/device.h include/sys_req.h include/string.h \
-  include/mpx/vm.h
+  include/mpx/vm.h include/mpx/multiboot.h include/mpx/klog.h
   
-kernel/sys_call.o: kernel/sys_call.c include/mpx/sys_call.h include/pcb.h include/string.h
+kernel/sys_call.o: kernel/sys_call.c include/mpx/sys_call.h include/pcb.h include/stdio.h \
+  include/mpx/serial.h include/mpx/device.h include/mpx/dcb.h \
+  include/mpx/arena.h include/mpx/stack.h include/string.h include/mpx/klog.h
+
+kernel/dcb.o: kernel/dcb.c include/mpx/dcb.h include/mpx/device.h \
+  include/mpx/serial.h include/mpx/interrupts.h include/sys_req.h \
+  include/pcb.h include/stdio.h include/mpx/sys_call.h include/mpx/arena.h \
+  include/mpx/stack.h include/mpx/klog.h include/mpx/keyboard.h include/mpx/vga.h
+
+kernel/arena.o: kernel/arena.c include/mpx/arena.h include/mpx/vm.h \
+  include/mpx/multiboot.h include/pcb.h include/mpx/dcb.h include/stdio.h include/mpx/sys_call.h \
+  include/mpx/stack.h
+
+kernel/stack.o: kernel/stack.c include/mpx/gdt.h include/mpx/interrupts.h \
+  include/mpx/panic.h include/mpx/stack.h include/mpx/vm.h include/string.h \
+  include/mpx/multiboot.h
+
+kernel/shm.o: kernel/shm.c include/mpx/shm.h include/mpx/vm.h \
+  include/mpx/multiboot.h include/pcb.h include/mpx/dcb.h include/stdio.h include/mpx/sys_call.h \
+  include/mpx/arena.h include/mpx/stack.h include/string.h
+
+kernel/xfer.o: kernel/xfer.c include/mpx/xfer.h include/mpx/device.h \
+  include/mpx/serial.h include/sys_req.h include/string.h
+
+kernel/klog.o: kernel/klog.c include/mpx/klog.h include/mpx/interrupts.h \
+  include/mpx/serial.h include/mpx/device.h include/stdio.h include/string.h
+
+kernel/vga.o: kernel/vga.c include/mpx/vga.h include/mpx/io.h include/string.h
+
+kernel/keyboard.o: kernel/keyboard.c include/mpx/keyboard.h include/mpx/interrupts.h \
+  include/mpx/io.h include/string.h
+
+kernel/ata.o: kernel/ata.c include/mpx/ata.h include/mpx/io.h
+
+kernel/bcache.o: kernel/bcache.c include/mpx/bcache.h include/mpx/ata.h \
+  include/mpx/klog.h include/mpx/vm.h include/mpx/multiboot.h include/string.h
 
 KERNEL_OBJECTS=\
 	kernel/core-asm.o\
 	kernel/sys_call_isr.o\
+	kernel/stack-asm.o\
+	kernel/serial-asm.o\
+	kernel/keyboard-asm.o\
 	kernel/serial.o\
 	kernel/kmain.o\
 	kernel/core-c.o\
-  kernel/sys_call.o
\ No newline at end of file
+  kernel/sys_call.o\
+	kernel/arena.o\
+	kernel/stack.o\
+	kernel/shm.o\
+	kernel/dcb.o\
+	kernel/xfer.o\
+	kernel/klog.o\
+	kernel/vga.o\
+	kernel/keyboard.o\
+	kernel/ata.o\
+	kernel/bcache.o
\ No newline at end of file
@@ -5,12 +5,17 @@ lib/string.o: lib/string.c include/string.h
 lib/stdlib.o: lib/stdlib.c include/stdlib.h include/ctype.h
 
 lib/core.o: lib/core.c include/mpx/serial.h include/mpx/device.h \
-  include/mpx/vm.h include/memory.h include/string.h
+  include/mpx/vm.h include/memory.h include/stdlib.h include/string.h
 
 lib/ctype.o: lib/ctype.c include/ctype.h
 
+lib/stdio.o: lib/stdio.c include/stdio.h include/string.h include/pcb.h include/mpx/dcb.h \
+  include/mpx/sys_call.h include/mpx/arena.h include/mpx/stack.h \
+  include/sys_req.h include/mpx/device.h
+
 LIB_OBJECTS=\
 	lib/string.o\
 	lib/stdlib.o\
 	lib/core.o\
-	lib/ctype.o
+	lib/ctype.o\
+	lib/stdio.o
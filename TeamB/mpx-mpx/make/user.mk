@@ -3,11 +3,26 @@
 user/core.o: user/core.c include/string.h include/mpx/serial.h \
   include/mpx/device.h include/processes.h include/sys_req.h
 
-user/interface.o: user/interface.c include/sys_req.h include/mpx/io.h include/string.h
+user/interface.o: user/interface.c include/sys_req.h include/mpx/io.h include/string.h \
+  include/stdlib.h include/pcb.h include/mpx/dcb.h include/stdio.h include/mpx/arena.h include/mpx/stack.h \
+  include/mpx/shm.h include/mpx/serial.h include/mpx/xfer.h include/mpx/klog.h include/mpx/bcache.h include/mpx/ata.h include/memory.h include/spawn.h \
+  user/interface.h
 
-user/pcb.o: user/pcb.c include/string.h include/pcb.h include/memory.h include/sys_req.h
+user/pcb.o: user/pcb.c include/string.h include/pcb.h include/mpx/dcb.h include/stdio.h include/mpx/arena.h \
+  include/mpx/stack.h include/memory.h include/mpx/vm.h \
+  include/mpx/multiboot.h include/mpx/shm.h include/sys_req.h
+
+user/spawn.o: user/spawn.c include/string.h include/pcb.h include/mpx/dcb.h include/stdio.h \
+  include/mpx/sys_call.h include/mpx/arena.h include/mpx/stack.h \
+  include/spawn.h include/sys_req.h include/mpx/device.h
+
+user/coro.o: user/coro.c include/coro.h include/memory.h include/mpx/panic.h \
+  include/sys_req.h include/mpx/device.h
 
 USER_OBJECTS=\
 	user/core.o \
 	user/interface.o \
-	user/pcb.o
\ No newline at end of file
+	user/pcb.o \
+	user/spawn.o \
+	user/coro.o \
+	user/coro-asm.o
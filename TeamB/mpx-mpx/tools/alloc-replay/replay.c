@@ -0,0 +1,402 @@
+/***********************************************************************
+* Replays an allocation trace captured with 'alloctrace dump' against
+* host-side models of heap allocators, and reports throughput, peak
+* footprint and fragmentation for each.
+*
+* Usage: replay [-a allocator] [-n iterations] [-s heap-bytes] trace.log
+*
+* The trace may be a raw serial capture; only lines of the form
+* "A|F timestamp size ptr" (hex fields) are used. To measure another
+* allocator, implement struct allocator and add it to allocators[].
+************************************************************************/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct op {
+	char op;		// 'A' or 'F'
+	uint32_t timestamp;
+	uint32_t size;
+	uint32_t ptr;
+};
+
+struct allocator {
+	const char *name;
+	void (*init)(unsigned char *heap, size_t size);
+	void *(*alloc)(size_t size);
+	int (*free)(void *ptr);
+	size_t (*footprint)(void);	// bytes of the heap touched so far
+};
+
+/***********************************************************************
+* Bump allocator, the model of kmalloc(): nothing is ever reused
+************************************************************************/
+
+static unsigned char *bump_heap;
+static size_t bump_size, bump_used;
+
+static void bump_init(unsigned char *heap, size_t size)
+{
+	bump_heap = heap;
+	bump_size = size;
+	bump_used = 0;
+}
+
+static void *bump_alloc(size_t size)
+{
+	size = (size + 7) & ~(size_t)7;
+	if (size > bump_size - bump_used) {
+		return NULL;
+	}
+	void *p = bump_heap + bump_used;
+	bump_used += size;
+	return p;
+}
+
+static int bump_free(void *ptr)
+{
+	(void)ptr;
+	return 0;
+}
+
+static size_t bump_footprint(void)
+{
+	return bump_used;
+}
+
+/***********************************************************************
+* Free list allocator with block headers, splitting and coalescing, in
+* first-fit and best-fit flavours
+************************************************************************/
+
+struct block {
+	struct block *next, *prev;	// address order, free and allocated
+	size_t size;			// usable bytes after the header
+	int free;
+};
+
+#define HDR	((sizeof(struct block) + 7) & ~(size_t)7)
+
+static struct block *list_head;
+static size_t list_high;		// furthest byte ever handed out
+static unsigned char *list_base;
+static int best_fit;
+
+static void list_init(unsigned char *heap, size_t size)
+{
+	list_base = heap;
+	list_head = (struct block *)heap;
+	list_head->next = list_head->prev = NULL;
+	list_head->size = size - HDR;
+	list_head->free = 1;
+	list_high = 0;
+}
+
+static void first_init(unsigned char *heap, size_t size)
+{
+	best_fit = 0;
+	list_init(heap, size);
+}
+
+static void best_init(unsigned char *heap, size_t size)
+{
+	best_fit = 1;
+	list_init(heap, size);
+}
+
+static void *list_alloc(size_t size)
+{
+	size = (size + 7) & ~(size_t)7;
+	struct block *fit = NULL;
+	for (struct block *b = list_head; b != NULL; b = b->next) {
+		if (b->free && b->size >= size && (fit == NULL || b->size < fit->size)) {
+			fit = b;
+			if (!best_fit || b->size == size) {
+				break;
+			}
+		}
+	}
+	if (fit == NULL) {
+		return NULL;
+	}
+
+	// split off the remainder if it can hold a header and something more
+	if (fit->size >= size + HDR + 8) {
+		struct block *rest = (struct block *)((unsigned char *)fit + HDR + size);
+		rest->size = fit->size - size - HDR;
+		rest->free = 1;
+		rest->prev = fit;
+		rest->next = fit->next;
+		if (rest->next != NULL) {
+			rest->next->prev = rest;
+		}
+		fit->next = rest;
+		fit->size = size;
+	}
+	fit->free = 0;
+
+	size_t end = (size_t)((unsigned char *)fit + HDR + fit->size - list_base);
+	if (end > list_high) {
+		list_high = end;
+	}
+	return (unsigned char *)fit + HDR;
+}
+
+static int list_free(void *ptr)
+{
+	struct block *b = (struct block *)((unsigned char *)ptr - HDR);
+	b->free = 1;
+	if (b->next != NULL && b->next->free) {
+		b->size += HDR + b->next->size;
+		b->next = b->next->next;
+		if (b->next != NULL) {
+			b->next->prev = b;
+		}
+	}
+	if (b->prev != NULL && b->prev->free) {
+		b->prev->size += HDR + b->size;
+		b->prev->next = b->next;
+		if (b->next != NULL) {
+			b->next->prev = b->prev;
+		}
+	}
+	return 0;
+}
+
+static size_t list_footprint(void)
+{
+	return list_high;
+}
+
+static const struct allocator allocators[] = {
+	{"bump", bump_init, bump_alloc, bump_free, bump_footprint},
+	{"firstfit", first_init, list_alloc, list_free, list_footprint},
+	{"bestfit", best_init, list_alloc, list_free, list_footprint},
+};
+
+#define NALLOCATORS	(sizeof(allocators) / sizeof(allocators[0]))
+
+/***********************************************************************
+* Trace loading and replay
+************************************************************************/
+
+static struct op *load_trace(const char *path, size_t *count, unsigned long *dropped)
+{
+	FILE *f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		return NULL;
+	}
+
+	size_t cap = 1024, n = 0;
+	struct op *ops = malloc(cap * sizeof(*ops));
+	char line[256];
+	*dropped = 0;
+	while (ops != NULL && fgets(line, sizeof(line), f) != NULL) {
+		struct op o;
+		unsigned long kept, lost;
+		if (sscanf(line, "# alloc trace %lu dropped %lu", &kept, &lost) == 2) {
+			*dropped += lost;
+			continue;
+		}
+		if ((line[0] != 'A' && line[0] != 'F') ||
+		    sscanf(line + 1, "%x %x %x", &o.timestamp, &o.size, &o.ptr) != 3) {
+			continue;
+		}
+		o.op = line[0];
+		if (n == cap) {
+			cap *= 2;
+			struct op *grown = realloc(ops, cap * sizeof(*ops));
+			if (grown == NULL) {
+				free(ops);
+				ops = NULL;
+				break;
+			}
+			ops = grown;
+		}
+		ops[n++] = o;
+	}
+	fclose(f);
+	*count = n;
+	return ops;
+}
+
+/* Open-addressed map from traced pointers to the replayed ones */
+struct slot {
+	uint32_t key;		// 0 means empty
+	void *ptr;
+	size_t size;
+};
+
+static struct slot *map;
+static size_t map_mask;
+
+static struct slot *map_find(uint32_t key)
+{
+	size_t i = (key * 2654435761u) & map_mask;
+	while (map[i].key != 0 && map[i].key != key) {
+		i = (i + 1) & map_mask;
+	}
+	return &map[i];
+}
+
+static void map_remove(struct slot *s)
+{
+	// backward-shift so later probes still find their keys
+	size_t i = (size_t)(s - map);
+	s->key = 0;
+	for (size_t j = (i + 1) & map_mask; map[j].key != 0; j = (j + 1) & map_mask) {
+		struct slot moved = map[j];
+		map[j].key = 0;
+		*map_find(moved.key) = moved;
+	}
+}
+
+struct result {
+	double seconds;
+	size_t peak_footprint;
+	size_t peak_live;
+	unsigned long failed;
+	unsigned long unmatched;
+};
+
+static void replay(const struct allocator *a, const struct op *ops, size_t n,
+		   unsigned char *heap, size_t heap_size, struct result *r)
+{
+	size_t live = 0;
+	memset(map, 0, (map_mask + 1) * sizeof(*map));
+	memset(r, 0, sizeof(*r));
+	a->init(heap, heap_size);
+
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (size_t i = 0; i < n; i++) {
+		if (ops[i].op == 'A') {
+			void *p = a->alloc(ops[i].size);
+			if (p == NULL || ops[i].ptr == 0) {
+				r->failed += p == NULL;
+				continue;
+			}
+			struct slot *s = map_find(ops[i].ptr);
+			s->key = ops[i].ptr;
+			s->ptr = p;
+			s->size = ops[i].size;
+			live += ops[i].size;
+			if (live > r->peak_live) {
+				r->peak_live = live;
+			}
+		} else {
+			struct slot *s = map_find(ops[i].ptr);
+			if (s->key == 0) {
+				r->unmatched++;	// allocated before the trace started
+				continue;
+			}
+			a->free(s->ptr);
+			live -= s->size;
+			map_remove(s);
+		}
+		size_t fp = a->footprint();
+		if (fp > r->peak_footprint) {
+			r->peak_footprint = fp;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	r->seconds = (double)(t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: replay [-a allocator] [-n iterations] [-s heap-bytes] trace.log\n");
+	fprintf(stderr, "allocators:");
+	for (size_t i = 0; i < NALLOCATORS; i++) {
+		fprintf(stderr, " %s", allocators[i].name);
+	}
+	fprintf(stderr, "\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *only = NULL;
+	unsigned long iterations = 100;
+	size_t heap_size = 16 << 20;
+	int i;
+
+	for (i = 1; i < argc - 1 && argv[i][0] == '-'; i += 2) {
+		if (strcmp(argv[i], "-a") == 0) {
+			only = argv[i + 1];
+		} else if (strcmp(argv[i], "-n") == 0) {
+			iterations = strtoul(argv[i + 1], NULL, 0);
+		} else if (strcmp(argv[i], "-s") == 0) {
+			heap_size = strtoul(argv[i + 1], NULL, 0);
+		} else {
+			usage();
+		}
+	}
+	if (i != argc - 1 || iterations == 0) {
+		usage();
+	}
+
+	size_t n;
+	unsigned long dropped;
+	struct op *ops = load_trace(argv[i], &n, &dropped);
+	if (ops == NULL) {
+		return 1;
+	}
+	if (n == 0) {
+		fprintf(stderr, "%s: no trace entries found\n", argv[i]);
+		return 1;
+	}
+
+	for (map_mask = 1; map_mask < 2 * n; map_mask <<= 1)
+		;
+	map = malloc(map_mask * sizeof(*map));
+	map_mask--;
+	unsigned char *heap = malloc(heap_size);
+	if (map == NULL || heap == NULL) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	uint32_t span = ops[n - 1].timestamp - ops[0].timestamp;
+	printf("%zu operations over %lu cycles", n, (unsigned long)span);
+	if (dropped != 0) {
+		printf(", %lu dropped before capture", dropped);
+	}
+	printf("\n%-10s %14s %14s %12s %8s %8s\n",
+	       "allocator", "ops/sec", "peak bytes", "peak live", "frag", "failed");
+
+	for (size_t a = 0; a < NALLOCATORS; a++) {
+		if (only != NULL && strcmp(only, allocators[a].name) != 0) {
+			continue;
+		}
+
+		struct result r;
+		double seconds = 0;
+		for (unsigned long it = 0; it < iterations; it++) {
+			replay(&allocators[a], ops, n, heap, heap_size, &r);
+			seconds += r.seconds;
+		}
+
+		// share of the touched heap that was not live data at the peak
+		double frag = r.peak_footprint == 0 ? 0 :
+		    1.0 - (double)r.peak_live / (double)r.peak_footprint;
+		printf("%-10s %14.0f %14zu %12zu %7.1f%% %8lu\n", allocators[a].name,
+		       seconds > 0 ? (double)n * iterations / seconds : 0,
+		       r.peak_footprint, r.peak_live, frag * 100, r.failed);
+		if (r.unmatched != 0) {
+			printf("%-10s %lu frees of blocks allocated before the trace\n", "",
+			       r.unmatched);
+		}
+	}
+
+	free(heap);
+	free(map);
+	free(ops);
+	return 0;
+}
@@ -0,0 +1,408 @@
+/***********************************************************************
+* Host side of the framed serial transfer in include/mpx/xfer.h.
+*
+* Usage: xfer -d device [-b baud] [-c command] recv out.bin
+*        xfer -d device [-b baud] [-c command] send in.bin
+*
+* recv takes what 'xfer dump' or 'xfer trace' sends; send feeds
+* 'xfer recv'. The device is the other end of the MPX console, e.g. the
+* pty QEMU prints for -serial pty. With -c the command is typed into
+* the console first (a carriage return is added), so one run does the
+* whole exchange; console text around the frames is skipped.
+************************************************************************/
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+// Kept in step with include/mpx/xfer.h
+#define XFER_MAGIC0		0xA5
+#define XFER_MAGIC1		0x5A
+#define XFER_MAX_PAYLOAD	1024
+#define XFER_RETRIES		8
+#define XFER_START_TRIES	30
+#define XFER_START	'S'
+#define XFER_DATA	'D'
+#define XFER_END	'E'
+#define XFER_ACK	'A'
+#define XFER_NAK	'N'
+#define XFER_ABORT	'X'
+
+// Most the kernel may stay quiet, before a frame or between its bytes
+#define TIMEOUT_MS	1000
+
+struct frame {
+	uint8_t type;
+	uint8_t seq;
+	uint16_t len;
+	uint8_t payload[XFER_MAX_PAYLOAD];
+};
+
+static int fd;
+static unsigned long retransmits;
+
+static uint32_t crc_table[256];
+
+static void crc_init(void)
+{
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+		for (int k = 0; k < 8; k++) {
+			c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		}
+		crc_table[n] = c;
+	}
+}
+
+static uint32_t crc32(uint32_t crc, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	crc = ~crc;
+	while (len-- > 0) {
+		crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void write_all(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	while (len > 0) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN) {
+				continue;
+			}
+			perror("write");
+			exit(1);
+		}
+		p += n;
+		len -= n;
+	}
+}
+
+static void send_frame(uint8_t type, uint8_t seq, const void *payload, uint16_t len)
+{
+	uint8_t head[6] = { XFER_MAGIC0, XFER_MAGIC1, type, seq, len & 0xFF, len >> 8 };
+	uint8_t tail[4];
+	put32(tail, crc32(crc32(0, head + 2, 4), payload, len));
+	write_all(head, sizeof(head));
+	write_all(payload, len);
+	write_all(tail, sizeof(tail));
+
+	// the reply can't start before the frame is on the wire, which at a
+	// slow rate is long after write() returned
+	tcdrain(fd);
+}
+
+/* Buffered read of one byte; 0 after TIMEOUT_MS without one */
+static int recv_byte(uint8_t *c)
+{
+	static uint8_t buf[4096];
+	static size_t have, next;
+
+	double deadline = now() + TIMEOUT_MS / 1000.0;
+	while (next == have) {
+		int ms = (int)((deadline - now()) * 1000);
+		if (ms <= 0) {
+			return 0;
+		}
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+		if (poll(&pfd, 1, ms) <= 0) {
+			continue;
+		}
+		ssize_t n = read(fd, buf, sizeof(buf));
+		if (n > 0) {
+			have = n;
+			next = 0;
+		}
+	}
+	*c = buf[next++];
+	return 1;
+}
+
+static int recv_bytes(uint8_t *p, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		if (!recv_byte(&p[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* 1 for an intact frame, 0 on a timeout, -1 if damaged */
+static int recv_frame(struct frame *f)
+{
+	uint8_t c = 0, prev;
+	do {
+		prev = c;
+		if (!recv_byte(&c)) {
+			return 0;
+		}
+	} while (prev != XFER_MAGIC0 || c != XFER_MAGIC1);
+
+	uint8_t head[4], tail[4];
+	if (!recv_bytes(head, sizeof(head))) {
+		return 0;
+	}
+	f->type = head[0];
+	f->seq = head[1];
+	f->len = head[2] | (head[3] << 8);
+	if (f->len > XFER_MAX_PAYLOAD) {
+		return -1;
+	}
+	if (!recv_bytes(f->payload, f->len) || !recv_bytes(tail, sizeof(tail))) {
+		return 0;
+	}
+	return get32(tail) == crc32(crc32(0, head, 4), f->payload, f->len) ? 1 : -1;
+}
+
+static int send_acked(uint8_t type, uint8_t seq, const void *payload, uint16_t len, int tries)
+{
+	struct frame reply;
+	for (int i = 0; i < tries; i++) {
+		if (i > 0) {
+			retransmits++;
+		}
+		send_frame(type, seq, payload, len);
+		int r = recv_frame(&reply);
+		if (r == 1 && reply.type == XFER_ABORT) {
+			fprintf(stderr, "xfer: the kernel aborted the transfer\n");
+			return -1;
+		}
+		if (r == 1 && reply.type == XFER_ACK && reply.seq == seq) {
+			return 0;
+		}
+	}
+	send_frame(XFER_ABORT, seq, NULL, 0);
+	fprintf(stderr, "xfer: no acknowledgement after %d tries\n", tries);
+	return -1;
+}
+
+static int do_send(const uint8_t *data, size_t len)
+{
+	uint8_t seq = 0;
+	uint8_t word[4];
+
+	put32(word, len);
+	if (send_acked(XFER_START, seq++, word, sizeof(word), XFER_START_TRIES) != 0) {
+		return -1;
+	}
+	for (size_t done = 0; done < len; seq++) {
+		uint16_t n = len - done < XFER_MAX_PAYLOAD ? len - done : XFER_MAX_PAYLOAD;
+		if (send_acked(XFER_DATA, seq, data + done, n, XFER_RETRIES) != 0) {
+			return -1;
+		}
+		done += n;
+	}
+	put32(word, crc32(0, data, len));
+	return send_acked(XFER_END, seq, word, sizeof(word), XFER_RETRIES);
+}
+
+static int do_recv(uint8_t **out, size_t *out_len)
+{
+	struct frame f;
+	uint8_t expect = 0;	// wraps on blobs over 255 frames
+	int started = 0;
+	uint8_t *data = NULL;
+	size_t total = 0, got = 0;
+	int timeouts = 0;
+
+	for (;;) {
+		int r = recv_frame(&f);
+		if (r == 0) {
+			if (++timeouts > (started ? XFER_RETRIES : XFER_START_TRIES)) {
+				fprintf(stderr, "xfer: the kernel stopped sending\n");
+				return -1;
+			}
+			continue;
+		}
+		timeouts = 0;
+		if (r < 0) {
+			send_frame(XFER_NAK, expect, NULL, 0);
+			continue;
+		}
+		if (f.type == XFER_ABORT) {
+			fprintf(stderr, "xfer: the kernel aborted the transfer\n");
+			return -1;
+		}
+		if (started && f.seq == (uint8_t)(expect - 1)) {
+			retransmits++;
+			send_frame(XFER_ACK, f.seq, NULL, 0);
+			continue;
+		}
+		if (f.seq != expect) {
+			send_frame(XFER_NAK, expect, NULL, 0);
+			continue;
+		}
+
+		if (f.type == XFER_START && !started && f.len == 4) {
+			total = get32(f.payload);
+			data = malloc(total ? total : 1);
+			if (data == NULL) {
+				send_frame(XFER_ABORT, f.seq, NULL, 0);
+				fprintf(stderr, "xfer: cannot hold %zu bytes\n", total);
+				return -1;
+			}
+			started = 1;
+		} else if (f.type == XFER_DATA && started && got + f.len <= total) {
+			memcpy(data + got, f.payload, f.len);
+			got += f.len;
+		} else if (f.type == XFER_END && started && f.len == 4) {
+			if (got != total || get32(f.payload) != crc32(0, data, got)) {
+				send_frame(XFER_ABORT, f.seq, NULL, 0);
+				fprintf(stderr, "xfer: the blob failed its CRC check\n");
+				return -1;
+			}
+			send_frame(XFER_ACK, f.seq, NULL, 0);
+
+			// if that ACK is lost the kernel repeats END; answer it once more
+			if (recv_frame(&f) == 1 && f.type == XFER_END) {
+				send_frame(XFER_ACK, f.seq, NULL, 0);
+			}
+			*out = data;
+			*out_len = got;
+			return 0;
+		} else {
+			send_frame(XFER_ABORT, f.seq, NULL, 0);
+			fprintf(stderr, "xfer: unexpected frame '%c'\n", f.type);
+			return -1;
+		}
+		send_frame(XFER_ACK, f.seq, NULL, 0);
+		expect++;
+	}
+}
+
+static speed_t baud_constant(long baud)
+{
+	switch (baud) {
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	}
+	fprintf(stderr, "xfer: unsupported baud rate %ld\n", baud);
+	exit(2);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: xfer -d device [-b baud] [-c command] recv|send file\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	const char *device = NULL, *command = NULL;
+	long baud = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:b:c:")) != -1) {
+		switch (opt) {
+		case 'd': device = optarg; break;
+		case 'b': baud = strtol(optarg, NULL, 10); break;
+		case 'c': command = optarg; break;
+		default: usage();
+		}
+	}
+	if (device == NULL || argc - optind != 2) {
+		usage();
+	}
+	const char *mode = argv[optind], *path = argv[optind + 1];
+	if (strcmp(mode, "recv") != 0 && strcmp(mode, "send") != 0) {
+		usage();
+	}
+
+	fd = open(device, O_RDWR | O_NOCTTY);
+	if (fd < 0) {
+		perror(device);
+		return 1;
+	}
+
+	// A tty gets raw mode; anything else (a socket via socat, say) is used as is
+	struct termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		if (baud != 0) {
+			cfsetispeed(&tio, baud_constant(baud));
+			cfsetospeed(&tio, baud_constant(baud));
+		}
+		tcsetattr(fd, TCSANOW, &tio);
+		tcflush(fd, TCIFLUSH);
+	}
+	crc_init();
+
+	uint8_t *data = NULL;
+	size_t len = 0;
+	if (strcmp(mode, "send") == 0) {
+		FILE *in = fopen(path, "rb");
+		if (in == NULL) {
+			perror(path);
+			return 1;
+		}
+		fseek(in, 0, SEEK_END);
+		len = ftell(in);
+		rewind(in);
+		data = malloc(len ? len : 1);
+		if (data == NULL || fread(data, 1, len, in) != len) {
+			fprintf(stderr, "xfer: cannot read %s\n", path);
+			return 1;
+		}
+		fclose(in);
+	}
+
+	if (command != NULL) {
+		write_all(command, strlen(command));
+		write_all("\r", 1);
+	}
+
+	double start = now();
+	int result = strcmp(mode, "send") == 0 ? do_send(data, len) : do_recv(&data, &len);
+	double elapsed = now() - start;
+	if (result != 0) {
+		return 1;
+	}
+
+	if (strcmp(mode, "recv") == 0) {
+		FILE *out = fopen(path, "wb");
+		if (out == NULL || fwrite(data, 1, len, out) != len || fclose(out) != 0) {
+			fprintf(stderr, "xfer: cannot write %s\n", path);
+			return 1;
+		}
+	}
+	printf("%zu bytes in %.2f s (%.0f bytes/s), CRC32 %08x, %lu retransmits\n",
+	       len, elapsed, elapsed > 0 ? len / elapsed : 0.0, crc32(0, data, len), retransmits);
+	free(data);
+	return 0;
+}
@@ -44,7 +44,7 @@ int sys_req(op_code op, ...)
 	int ret = 0;
 	__asm__ volatile("int $0x60" : "=a"(ret) : "a"(op), "b"(dev), "c"(buffer), "d"(len));
 
-	if (ret == -1 && (op == READ || op == WRITE)) {
+	if (ret == POLL_DEVICE && (op == READ || op == WRITE)) {
 		return (op == READ)
 			? serial_poll(dev, buffer, len)
 			: serial_out(dev, buffer, len);
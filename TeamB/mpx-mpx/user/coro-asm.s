@@ -0,0 +1,23 @@
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+; Coroutine context switch. Only the callee-saved registers need keeping;
+; the compiler already assumes eax, ecx and edx are lost across the call.
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+bits 32
+global coro_switch
+
+;; void coro_switch(uint32_t *save_esp, uint32_t new_esp)
+coro_switch:
+	mov eax, [esp + 4]	;; save_esp
+	mov edx, [esp + 8]	;; new_esp
+	push ebx
+	push esi
+	push edi
+	push ebp
+	mov [eax], esp		;; this context resumes from here
+	mov esp, edx
+	pop ebp
+	pop edi
+	pop esi
+	pop ebx
+	ret			;; into the resumed context
@@ -0,0 +1,184 @@
+#include <stdint.h>
+#include <coro.h>
+#include <memory.h>
+#include <mpx/panic.h>
+#include <sys_req.h>
+
+// Function to add a coroutine to the back of the run queue
+static void run_push(struct coro_sched *s, struct coro *c)
+{
+    c->next = NULL;
+    if (s->run_tail == NULL)
+    {
+        s->run_head = c;
+    }
+    else
+    {
+        s->run_tail->next = c;
+    }
+    s->run_tail = c;
+}
+
+// Function to switch from the running coroutine back to the scheduler
+static void to_scheduler(struct coro_sched *s)
+{
+    struct coro *c = s->current;
+    coro_switch(&c->esp, s->esp);
+}
+
+// First code a coroutine runs; coro_create() leaves s above it on the stack
+static void coro_entry(struct coro_sched *s)
+{
+    struct coro *c = s->current;
+    c->fn(c->arg);
+
+    // Finished; keep the coroutine and its stack for the next coro_create()
+    c->next = s->free;
+    s->free = c;
+    s->live--;
+    to_scheduler(s);
+}
+
+// Function to prepare an empty scheduler
+void coro_sched_init(struct coro_sched *s)
+{
+    s->run_head = NULL;
+    s->run_tail = NULL;
+    s->waiting = NULL;
+    s->free = NULL;
+    s->current = NULL;
+    s->esp = 0;
+    s->live = 0;
+}
+
+// Function to create a runnable coroutine
+struct coro *coro_create(struct coro_sched *s, void (*fn)(void *), void *arg, size_t stack_size)
+{
+    if (stack_size == 0)
+    {
+        stack_size = CORO_STACK_DEFAULT;
+    }
+    if (stack_size < CORO_STACK_MIN)
+    {
+        stack_size = CORO_STACK_MIN;
+    }
+    stack_size = (stack_size + 3) & ~(size_t)3;
+
+    // Reuse a finished coroutine whose stack is big enough
+    struct coro *c = NULL;
+    for (struct coro **link = &s->free; *link != NULL; link = &(*link)->next)
+    {
+        if ((*link)->stack_size >= stack_size)
+        {
+            c = *link;
+            *link = c->next;
+            break;
+        }
+    }
+    if (c == NULL)
+    {
+        c = sys_alloc_mem(sizeof(struct coro));
+        if (c == NULL)
+        {
+            return NULL;
+        }
+        c->stack = sys_alloc_mem(stack_size);
+        if (c->stack == NULL)
+        {
+            sys_free_mem(c);
+            return NULL;
+        }
+        c->stack_size = stack_size;
+    }
+
+    c->fn = fn;
+    c->arg = arg;
+    c->ready = NULL;
+    c->stack[0] = CORO_CANARY;
+
+    // The frame coro_switch() pops: ebp, edi, esi, ebx, then it returns into
+    // coro_entry() with a dummy return address and s as the argument
+    uint32_t *sp = c->stack + c->stack_size / sizeof(uint32_t);
+    *--sp = (uint32_t)s;
+    *--sp = 0;
+    *--sp = (uint32_t)coro_entry;
+    for (int i = 0; i < 4; i++)
+    {
+        *--sp = 0;
+    }
+    c->esp = (uint32_t)sp;
+
+    s->live++;
+    run_push(s, c);
+    return c;
+}
+
+// Function to let the other runnable coroutines run
+void coro_yield(struct coro_sched *s)
+{
+    run_push(s, s->current);
+    to_scheduler(s);
+}
+
+// Function to park the running coroutine until ready(arg) is true
+void coro_wait(struct coro_sched *s, int (*ready)(void *), void *arg)
+{
+    struct coro *c = s->current;
+    c->ready = ready;
+    c->ready_arg = arg;
+    c->next = s->waiting;
+    s->waiting = c;
+    to_scheduler(s);
+}
+
+// Function to move every waiting coroutine whose condition holds to the run queue
+static void poll_waiting(struct coro_sched *s)
+{
+    struct coro **link = &s->waiting;
+    while (*link != NULL)
+    {
+        struct coro *c = *link;
+        if (c->ready(c->ready_arg))
+        {
+            *link = c->next;
+            c->ready = NULL;
+            run_push(s, c);
+        }
+        else
+        {
+            link = &c->next;
+        }
+    }
+}
+
+// Function to run coroutines until all have finished
+void coro_run(struct coro_sched *s)
+{
+    while (s->live > 0)
+    {
+        poll_waiting(s);
+
+        // Only the kernel can make progress for us now
+        if (s->run_head == NULL)
+        {
+            sys_req(IDLE);
+            continue;
+        }
+
+        struct coro *c = s->run_head;
+        s->run_head = c->next;
+        if (s->run_head == NULL)
+        {
+            s->run_tail = NULL;
+        }
+
+        s->current = c;
+        coro_switch(&s->esp, c->esp);
+        s->current = NULL;
+
+        if (c->stack[0] != CORO_CANARY)
+        {
+            kpanic("Coroutine stack overflow");
+        }
+    }
+}
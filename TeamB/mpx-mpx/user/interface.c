@@ -10,8 +10,17 @@
 #include <sys_req.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <spawn.h>
 #include <pcb.h>
 #include <processes.h>
+#include <mpx/shm.h>
+#include <mpx/serial.h>
+#include <mpx/xfer.h>
+#include <mpx/klog.h>
+#include <mpx/bcache.h>
+#include <mpx/vm.h>
+#include <memory.h>
 #include "interface.h"
 
 // RTC Register addresses (from the Intel document)
@@ -68,17 +77,7 @@ void get_date_command()
     month = bcd_to_binary(read_rtc(RTC_MONTH));
     year = bcd_to_binary(read_rtc(RTC_YEAR));
 
-    char date_str[12];
-    binary_to_ascii(month, date_str);
-    date_str[2] = '/';
-    binary_to_ascii(day, date_str + 3);
-    date_str[5] = '/';
-    binary_to_ascii(year, date_str + 6);
-    date_str[8] = '\r';
-    date_str[9] = '\n';
-    date_str[10] = '\0';
-
-    sys_req(WRITE, COM1, date_str, strlen(date_str));
+    printf("%02d/%02d/%02d\r\n", month, day, year);
 }
 
 // Function to get the current time from RTC
@@ -89,22 +88,9 @@ void get_time_command()
     minutes = bcd_to_binary(read_rtc(RTC_MINUTES));
     hours = bcd_to_binary(read_rtc(RTC_HOURS));
 
-    char time_str[12];
-    binary_to_ascii(hours, time_str);
-    time_str[2] = ':';
-    binary_to_ascii(minutes, time_str + 3);
-    time_str[5] = ':';
-    binary_to_ascii(seconds, time_str + 6);
-    time_str[8] = '\r';
-    time_str[9] = '\n';
-    time_str[10] = '\0';
-
-    sys_req(WRITE, COM1, time_str, strlen(time_str));
+    printf("%02d:%02d:%02d\r\n", hours, minutes, seconds);
 }
 
-// shutdown flag
-int should_shutdown = 0;
-
 typedef struct
 {
     const char *name;
@@ -115,7 +101,7 @@ typedef struct
 // Forward declarations
 void version_command();
 void help_command();
-void shutdown_command();
+int shutdown_command(const char *args);
 void get_date_command();
 void get_date_command();
 void set_date_command(const char *args);
@@ -137,12 +123,25 @@ void set_pcb_priority_command(const char *args);
 void yield_command(const char *args);
 void loadR3_command(const char *args);
 void alarm_command(const char *args);
-void alarm_proc();
+int alarm_proc(void *arg);
+void meminfo_command(const char *args);
+void swapmode_command(const char *args);
+void showshm_command(const char *args);
+void alloctrace_command(const char *args);
+void serialstats_command(const char *args);
+void serialcfg_command(const char *args);
+void xfer_command(const char *args);
+void dmesg_command(const char *args);
+void loglevel_command(const char *args);
+void disk_command(const char *args);
+
+// Whether suspendpcb swaps out the stack of the process it suspends
+static int swap_on_suspend = 0;
 
 //com struct
 command_t commands[] = {
     {"version", version_command, "Displays the current version of MPX and the compilation date"},
-    {"shutdown", shutdown_command, "Shutdown the system with confirmation"},
+    {"shutdown", NULL, "Shutdown the system with confirmation"}, // run by comhand() itself
     {"help", help_command, "Provides usage instruction for all commands"},
     {"getdate", get_date_command, "Get the current date"},
     {"setdate", set_date_command, "Set the date: 'setdate [MM/DD/YY]'"},
@@ -161,6 +160,16 @@ command_t commands[] = {
     {"yield",yield_command,"Yield the CPU"},
     {"loadR3",loadR3_command,"Load R3"},
     {"alarm",alarm_command,"Set an alarm to display a message at a specific time"},
+    {"meminfo", meminfo_command, "Shows PCB pool usage"},
+    {"swapmode", swapmode_command, "Swap out the stacks of suspended PCBs: 'swapmode [on|off]'"},
+    {"showshm", showshm_command, "Shows shared memory regions and how many processes use each"},
+    {"alloctrace", alloctrace_command, "Record heap operations for tools/alloc-replay: 'alloctrace [on|off|dump]'"},
+    {"serialstats", serialstats_command, "Shows transmit counters for this console's port"},
+    {"dmesg", dmesg_command, "Shows the kernel log, optionally only down to a level: 'dmesg [err|warn|info|debug]'"},
+    {"loglevel", loglevel_command, "Show or set the least severe kernel log level printed: 'loglevel [err|warn|info|debug]'"},
+    {"xfer", xfer_command, "Binary transfer with tools/xfer: 'xfer dump [addr] [len]', 'xfer trace' or 'xfer recv [len]'"},
+    {"disk", disk_command, "Use the disk through its block cache: 'disk [info|stats|sync|read [block]|write [block] [text]]'"},
+    {"serialcfg", serialcfg_command, "Show or set a port's line: 'serialcfg [com1-4] [baud] [fifo 1|4|8|14] [flow on|off]'"},
     {NULL, NULL, NULL}};
 
 // Function to remove trailing whitespace from input
@@ -180,7 +189,7 @@ void version_command(const char *args)
     (void)args; // Mark the parameter as unused
 
     char version_msg[] = "MPX Version: R3, Compiled on: 15th November 2023\r\n";
-    sys_req(WRITE, COM1, version_msg, sizeof(version_msg));
+    sys_req(WRITE, current_console(), version_msg, sizeof(version_msg));
 }
 
 // Command for displaying usage instructions for all commands
@@ -192,46 +201,46 @@ void help_command(const char *args)
         {
             if (strcmp(args, cmd->name) == 0)
             {
-                sys_req(WRITE, COM1, cmd->name, strlen(cmd->name));
-                sys_req(WRITE, COM1, " - ", strlen(" - "));
-                sys_req(WRITE, COM1, cmd->description, strlen(cmd->description));
-                sys_req(WRITE, COM1, "\r\n", strlen("\r\n"));
+                sys_req(WRITE, current_console(), cmd->name, strlen(cmd->name));
+                sys_req(WRITE, current_console(), " - ", strlen(" - "));
+                sys_req(WRITE, current_console(), cmd->description, strlen(cmd->description));
+                sys_req(WRITE, current_console(), "\r\n", strlen("\r\n"));
                 return;
             }
         }
-        sys_req(WRITE, COM1, "Command not found.\r\n", strlen("Command not found.\r\n"));
+        sys_req(WRITE, current_console(), "Command not found.\r\n", strlen("Command not found.\r\n"));
     }
     else
     {
         for (command_t *cmd = commands; cmd->name; cmd++)
         {
-            sys_req(WRITE, COM1, cmd->name, strlen(cmd->name));
-            sys_req(WRITE, COM1, " - ", strlen(" - "));
-            sys_req(WRITE, COM1, cmd->description, strlen(cmd->description));
-            sys_req(WRITE, COM1, "\r\n", strlen("\r\n"));
+            sys_req(WRITE, current_console(), cmd->name, strlen(cmd->name));
+            sys_req(WRITE, current_console(), " - ", strlen(" - "));
+            sys_req(WRITE, current_console(), cmd->description, strlen(cmd->description));
+            sys_req(WRITE, current_console(), "\r\n", strlen("\r\n"));
         }
     }
 }
 
-// Command for shutting down the OS
-void shutdown_command(const char *args)
+// Command for shutting down the OS; returns 1 once confirmed, which ends
+// the calling comhand only, so each console answers for itself
+int shutdown_command(const char *args)
 {
     (void)args; // Mark the parameter as unused
-    sys_req(WRITE, COM1, "Are you sure you want to shutdown? (yes/no): ", 46);
+    sys_req(WRITE, current_console(), "Are you sure you want to shutdown? (yes/no): ", 46);
     char confirmation[5];
-    sys_req(READ, COM1, confirmation, 5); // Read 5 characters
+    sys_req(READ, current_console(), confirmation, 5); // Read 5 characters
     confirmation[4] = '\0';               // Ensure it's null-terminated
 
     if (strcmp(confirmation, "yes\n") == 0)
     { // Check for "yes" followed by Enter (\n)
-        sys_req(WRITE, COM1, "Shutting down...\r\n", 18);
-        should_shutdown = 1; // Set global variable
-    }
-    else
-    {
-        sys_req(WRITE, COM1, "Shutdown cancelled.\r\n", 21);
-        should_shutdown = 0; // Reset the global variable just in case
+        sys_req(WRITE, current_console(), "Shutting down...\r\n", 18);
+        bcache_sync(); // Cached disk writes would be lost otherwise
+        return 1;
     }
+
+    sys_req(WRITE, current_console(), "Shutdown cancelled.\r\n", 21);
+    return 0;
 }
 
 // Command for setting the date
@@ -239,14 +248,14 @@ void set_date_command(const char *date_str)
 {
     if (date_str == NULL)
     {
-        sys_req(WRITE, COM1, "Enter the date next to the command\r\n", 37);
+        sys_req(WRITE, current_console(), "Enter the date next to the command\r\n", 37);
         return;
     }
     else
     {
         if (strlen(date_str) != 8)
         {
-            sys_req(WRITE, COM1, "Invalid date format(MM/DD/YY).\r\n", 33);
+            sys_req(WRITE, current_console(), "Invalid date format(MM/DD/YY).\r\n", 33);
             return;
         }
 
@@ -258,7 +267,7 @@ void set_date_command(const char *date_str)
         // Check for valid month and day
         if (month < 1 || month > 12 || day < 1 || day > 31)
         {
-            sys_req(WRITE, COM1, "Invalid date values.\r\n", 23);
+            sys_req(WRITE, current_console(), "Invalid date values.\r\n", 23);
             return;
         }
 
@@ -271,7 +280,7 @@ void set_date_command(const char *date_str)
         // Check if the current date matches the desired date
         if (current_month == month && current_day == day && current_year == year)
         {
-            sys_req(WRITE, COM1, "Date is already set to the desired value.\r\n", 43);
+            sys_req(WRITE, current_console(), "Date is already set to the desired value.\r\n", 43);
             return;
         }
 
@@ -280,7 +289,7 @@ void set_date_command(const char *date_str)
         {
             if (!((year % 4 == 0 && year % 100 != 0) || (year % 400 == 0)))
             {
-                sys_req(WRITE, COM1, "Invalid date (not a leap year).\r\n", 34);
+                sys_req(WRITE, current_console(), "Invalid date (not a leap year).\r\n", 34);
                 return;
             }
             else
@@ -302,11 +311,11 @@ void set_date_command(const char *date_str)
 
         if (current_month == month && current_day == day && current_year == year)
         {
-            sys_req(WRITE, COM1, "Date set successfully.\r\n", 25);
+            sys_req(WRITE, current_console(), "Date set successfully.\r\n", 25);
         }
         else
         {
-            sys_req(WRITE, COM1, "Failed to set the date. Can you redo the command\r\n", 23);
+            sys_req(WRITE, current_console(), "Failed to set the date. Can you redo the command\r\n", 23);
         }
     }
 }
@@ -318,7 +327,7 @@ void set_time_command(const char *time_str)
     {
         char msg[] = "Enter the time next to the command\r\n\0";
 
-        sys_req(WRITE, COM1, msg, sizeof(msg));
+        sys_req(WRITE, current_console(), msg, sizeof(msg));
 
         return;
     }
@@ -327,7 +336,7 @@ void set_time_command(const char *time_str)
         if (strlen(time_str) != 8)
         {
 
-            sys_req(WRITE, COM1, "Invalid time format(hh:mm:ss).\r\n\0", 36);
+            sys_req(WRITE, current_console(), "Invalid time format(hh:mm:ss).\r\n\0", 36);
             return;
         }
 
@@ -339,7 +348,7 @@ void set_time_command(const char *time_str)
         if (hours > 23 || minutes > 59 || seconds > 59)
         {
 
-            sys_req(WRITE, COM1, "Invalid time values.\r\n", 23);
+            sys_req(WRITE, current_console(), "Invalid time values.\r\n", 23);
             return;
         }
 
@@ -347,7 +356,7 @@ void set_time_command(const char *time_str)
         write_rtc(RTC_MINUTES, binary_to_bcd(minutes));
         write_rtc(RTC_SECONDS, binary_to_bcd(seconds));
 
-        sys_req(WRITE, COM1, "Time set successfully.\r\n", 26);
+        sys_req(WRITE, current_console(), "Time set successfully.\r\n", 26);
     }
 }
 
@@ -358,7 +367,7 @@ void show_pcb_command(const char *showpcb_str)
     if (showpcb_str == NULL)
     {
         char err_msg[] = "Include the name of the process: 'showpcb [name]'";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg) - 1);
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg) - 1);
 
         return;
     }
@@ -366,7 +375,7 @@ void show_pcb_command(const char *showpcb_str)
     if (strlen(showpcb_str) > 8)
     {
         char err_msg[] = "Invalid process name (no more than 8 characters)";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg) - 1);
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg) - 1);
 
         return;
     }
@@ -377,7 +386,7 @@ void show_pcb_command(const char *showpcb_str)
     if (target_pcb == NULL)
     {
         char err_msg[] = "Process not found";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg) - 1);
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg) - 1);
 
         return;
     }
@@ -389,30 +398,20 @@ void show_pcb_command(const char *showpcb_str)
         char *states[] = {"Ready", "Blocked"};
         char *statuses[] = {"Not Suspended", "Suspended"};
 
-        // Display PCB name
-        sys_req(WRITE, COM1, "Name: ", 6);
-        sys_req(WRITE, COM1, target_pcb->process_name, sizeof(target_pcb->process_name) - 1);
-        sys_req(WRITE, COM1, "\r\n", 2);
-
-        // Display PCB class
-        sys_req(WRITE, COM1, "Class: ", 7);
-        sys_req(WRITE, COM1, classes[target_pcb->process_class], strlen(classes[target_pcb->process_class]));
-        sys_req(WRITE, COM1, "\r\n", 2);
-
-        // Display PCB execution state
-        sys_req(WRITE, COM1, "State: ", 7);
-        sys_req(WRITE, COM1, states[target_pcb->execution_state], strlen(states[target_pcb->execution_state]));
-        sys_req(WRITE, COM1, "\r\n", 2);
+        // One line per field, each written with a single WRITE
+        printf("Name: %s\r\n", target_pcb->cold->process_name);
+        printf("Class: %s\r\n", classes[target_pcb->process_class]);
+        printf("State: %s\r\n", states[target_pcb->execution_state]);
+        printf("Status: %s\r\n", statuses[target_pcb->dispatching_state]);
+        printf("Priority: %d\r\n", target_pcb->process_priority);
 
-        // Display PCB suspension status
-        sys_req(WRITE, COM1, "Status: ", 8);
-        sys_req(WRITE, COM1, statuses[target_pcb->dispatching_state], strlen(statuses[target_pcb->dispatching_state]));
-        sys_req(WRITE, COM1, "\r\n", 2);
+        // Display the memory held in the PCB's arena
+        printf("Memory: %u bytes used, %u bytes reserved\r\n",
+               target_pcb->cold->arena.used, target_pcb->cold->arena.reserved);
 
-        // Display PCB priority using sys_req
-        char priority_msg[] = "Priority: x\r\n";
-        priority_msg[10] = '0' + target_pcb->process_priority; // Convert integer to character
-        sys_req(WRITE, COM1, priority_msg, sizeof(priority_msg) - 1);
+        // Display the deepest the stack has been and how much is backed by memory
+        printf("Stack: peak %u, %u of %u bytes mapped\r\n", stack_peak(&target_pcb->cold->stack),
+               target_pcb->cold->stack.mapped, target_pcb->cold->stack.limit);
     }
 }
 
@@ -425,16 +424,16 @@ void show_queue(struct queue *q)
         while (current != NULL)
         {
             // Use the show_pcb_command function to print each PCB's details
-            show_pcb_command(current->process_name);
+            show_pcb_command(current->cold->process_name);
             current = current->next;
             char msg[] = "~~~~~~~~~~~~\r\n\0";
-            sys_req(WRITE, COM1, msg, sizeof(msg));
+            sys_req(WRITE, current_console(), msg, sizeof(msg));
         }
     }
     else
     {
         char msg[] = "Queue is empty.\r\n\0";
-        sys_req(WRITE, COM1, msg, sizeof(msg));
+        sys_req(WRITE, current_console(), msg, sizeof(msg));
     }
 }
 
@@ -449,11 +448,11 @@ void show_all_pcbs_command()
 void show_ready_pcbs_command()
 {
     char readyMsg[] = "---------Ready Queue:---------\r\n\0";
-    sys_req(WRITE, COM1, readyMsg, sizeof(readyMsg));
+    sys_req(WRITE, current_console(), readyMsg, sizeof(readyMsg));
     show_queue(get_ready_q());
 
     char suspReadyMsg[] = "---------Suspended Ready Queue:---------\r\n\0";
-    sys_req(WRITE, COM1, suspReadyMsg, sizeof(suspReadyMsg));
+    sys_req(WRITE, current_console(), suspReadyMsg, sizeof(suspReadyMsg));
     show_queue(get_susp_ready_q());
 }
 
@@ -461,11 +460,11 @@ void show_ready_pcbs_command()
 void show_blocked_pcbs_command()
 {
     char blockedMsg[] = "---------Blocked Queue:---------\r\n\0";
-    sys_req(WRITE, COM1, blockedMsg, sizeof(blockedMsg));
+    sys_req(WRITE, current_console(), blockedMsg, sizeof(blockedMsg));
     show_queue(get_blocked_q());
 
     char suspBlockedMsg[] = "---------Suspended Blocked Queue:---------\r\n\0";
-    sys_req(WRITE, COM1, suspBlockedMsg, sizeof(suspBlockedMsg));
+    sys_req(WRITE, current_console(), suspBlockedMsg, sizeof(suspBlockedMsg));
     show_queue(get_susp_blocked_q());
 }
 
@@ -475,7 +474,7 @@ void delete_pcb_command(const char *name)
     if (name == NULL || strlen(name) == 0)
     {
         char msg[] = "Process not found\r\n\0";
-        sys_req(WRITE, COM1, msg, sizeof(msg));
+        sys_req(WRITE, current_console(), msg, sizeof(msg));
         return;
     }
 
@@ -486,27 +485,27 @@ void delete_pcb_command(const char *name)
         if (pcb->process_class == SYSTEM_PROCESS)
         {
             char err_msg[] = "Cannot delete a System Process\r\n\0";
-            sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+            sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
             return;
         }
         // Remove the PCB from its queue
         if (pcb_remove(pcb) == 0)
         {
-            // Free the associated memory
-            pcb_free(pcb);
+            // Hand the PCB to the reaper
+            pcb_exit(pcb, -1);
             char succ_msg[] = "PCB deleted successfully\r\n\0";
-            sys_req(WRITE, COM1, succ_msg, sizeof(succ_msg));
+            sys_req(WRITE, current_console(), succ_msg, sizeof(succ_msg));
         }
         else
         {
             char err_msg[] = "Error deleting PCB\r\n\0";
-            sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+            sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
         }
     }
     else
     {
         char err_msg[] = "Process not found\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
     }
 }
 
@@ -516,7 +515,7 @@ void suspend_pcb_command(const char *name)
     if (name == NULL || strlen(name) == 0)
     {
         char err_msg[] = "Usage: suspendpcb [name]\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
     }
 
     struct pcb *pcb = pcb_find(name);
@@ -527,7 +526,7 @@ void suspend_pcb_command(const char *name)
         if (pcb->process_class == SYSTEM_PROCESS)
         {
             char err_msg[] = "System processes cannot be suspended.\r\n\0";
-            sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+            sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
         }
         else
         {
@@ -535,7 +534,7 @@ void suspend_pcb_command(const char *name)
             if (pcb->dispatching_state == SUSPENDED)
             {
                 char err_msg[] = "PCB is already in a suspended state.\r\n\0";
-                sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+                sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
             }
             else
             {
@@ -547,14 +546,22 @@ void suspend_pcb_command(const char *name)
 
                 pcb_insert(pcb); // Insert into the suspended queue
 
+                // Keep only the live part of the stack while the process is parked,
+                // unless a device may still write into a buffer on it
+                if (swap_on_suspend && !pcb->cold->io.queued
+                    && stack_swap_out(&pcb->cold->stack, (uint32_t)pcb->stack_ptr) != 0)
+                {
+                    sys_req(WRITE, current_console(), "Stack could not be swapped out.\r\n", 33);
+                }
+
                 char succ_msg[] = "PCB suspended successfully.\r\n\0";
-                sys_req(WRITE, COM1, succ_msg, sizeof(succ_msg));
+                sys_req(WRITE, current_console(), succ_msg, sizeof(succ_msg));
             }
         }
     }
     else
     {
-        sys_req(WRITE, COM1, "PCB not found.\r\n", 17);
+        sys_req(WRITE, current_console(), "PCB not found.\r\n", 17);
     }
 }
 
@@ -564,7 +571,7 @@ void resume_pcb_command(const char *resumepcb_str)
     if (resumepcb_str == NULL)
     {
         char err_msg[] = "Include the name of the process: 'resumepcb [name]'\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -572,7 +579,7 @@ void resume_pcb_command(const char *resumepcb_str)
     if (strlen(resumepcb_str) > 8)
     {
         char err_msg[] = "Invalid process name (no more than 8 characters)\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -583,7 +590,16 @@ void resume_pcb_command(const char *resumepcb_str)
     if (pcb_to_resume == NULL)
     {
         char err_msg[] = "Process not found\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
+
+        return;
+    }
+
+    // Bring back the stack if it was swapped out while suspended
+    if (stack_swap_in(&pcb_to_resume->cold->stack) != 0)
+    {
+        char err_msg[] = "Not enough memory to swap the stack back in\r\n\0";
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -592,7 +608,7 @@ void resume_pcb_command(const char *resumepcb_str)
     if (pcb_remove(pcb_to_resume) == -1)
     {
         char err_msg[] = "Process failed to resume\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -604,7 +620,7 @@ void resume_pcb_command(const char *resumepcb_str)
     pcb_insert(pcb_to_resume);
 
     char success_msg[] = "PCB successfully resumed\r\n\0";
-    sys_req(WRITE, COM1, success_msg, sizeof(success_msg));
+    sys_req(WRITE, current_console(), success_msg, sizeof(success_msg));
 }
 
 void block_pcb_command(const char *blockpcb_str)
@@ -613,7 +629,7 @@ void block_pcb_command(const char *blockpcb_str)
     if (blockpcb_str == NULL)
     {
         char err_msg[] = "Include the name of the process: 'blockpcb [name]'\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -621,7 +637,7 @@ void block_pcb_command(const char *blockpcb_str)
     if (strlen(blockpcb_str) > 8)
     {
         char err_msg[] = "Invalid process name (no more than 8 characters)\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -632,7 +648,7 @@ void block_pcb_command(const char *blockpcb_str)
     if (pcb_to_block == NULL)
     {
         char err_msg[] = "Process not found\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -641,7 +657,7 @@ void block_pcb_command(const char *blockpcb_str)
     if (pcb_to_block->process_class == SYSTEM_PROCESS)
     {
         char err_msg[] = "Cannot block a System Process\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -650,7 +666,7 @@ void block_pcb_command(const char *blockpcb_str)
     if (pcb_remove(pcb_to_block) == -1)
     {
         char err_msg[] = "Process failed to resume\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -662,7 +678,7 @@ void block_pcb_command(const char *blockpcb_str)
     pcb_insert(pcb_to_block);
 
     char success_msg[] = "PCB successfully blocked\r\n\0";
-    sys_req(WRITE, COM1, success_msg, sizeof(success_msg));
+    sys_req(WRITE, current_console(), success_msg, sizeof(success_msg));
 }
 
 void unblock_pcb_command(const char *unblockpcb_str)
@@ -671,7 +687,7 @@ void unblock_pcb_command(const char *unblockpcb_str)
     if (unblockpcb_str == NULL)
     {
         char err_msg[] = "Include the name of the process: 'unblockpcb [name]'\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -679,7 +695,7 @@ void unblock_pcb_command(const char *unblockpcb_str)
     if (strlen(unblockpcb_str) > 8)
     {
         char err_msg[] = "Invalid process name (no more than 8 characters)\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -690,7 +706,16 @@ void unblock_pcb_command(const char *unblockpcb_str)
     if (pcb_to_unblock == NULL)
     {
         char err_msg[] = "Process not found\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
+
+        return;
+    }
+
+    // Only the device may wake a process blocked on READ or WRITE
+    if (pcb_to_unblock->cold->io.queued)
+    {
+        char err_msg[] = "Process is waiting for I/O\r\n\0";
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -699,7 +724,7 @@ void unblock_pcb_command(const char *unblockpcb_str)
     if (pcb_remove(pcb_to_unblock) == -1)
     {
         char err_msg[] = "Process failed to resume\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
@@ -711,7 +736,7 @@ void unblock_pcb_command(const char *unblockpcb_str)
     pcb_insert(pcb_to_unblock);
 
     char success_msg[] = "PCB successfully unblocked\r\n\0";
-    sys_req(WRITE, COM1, success_msg, sizeof(success_msg));
+    sys_req(WRITE, current_console(), success_msg, sizeof(success_msg));
 }
 
 // Command for setting the priority of a PCB in the format: 'setpcbpriority [name] [newpriority]'
@@ -720,7 +745,7 @@ void set_pcb_priority_command(const char *args)
     if (args == NULL)
     {
         char err_msg[] = "Invalid format: 'setpcbpriority [name] [newpriority]'\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
         return;
     }
 
@@ -740,7 +765,7 @@ void set_pcb_priority_command(const char *args)
     if (num_tokens != 2)
     {
         char err_msg[] = "Please provide the name and newpriority\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
         return;
     }
 
@@ -748,7 +773,7 @@ void set_pcb_priority_command(const char *args)
     if (strlen(tokens[0]) > 8)
     {
         char err_msg[] = "Process names must be no more than 8 characters long\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
         return;
     }
 
@@ -759,82 +784,548 @@ void set_pcb_priority_command(const char *args)
     if (result == -1)
     {
         char err_msg[] = "Process not found\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
     }
     else if (result == -2)
     {
         char err_msg[] = "Invalid priority, new priority must be an integer between 0 and 9 \r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
     }
     else if (result == 0)
     {
         char success_msg[] = "PCB priority successfully updated\r\n\0";
-        sys_req(WRITE, COM1, success_msg, sizeof(success_msg));
+        sys_req(WRITE, current_console(), success_msg, sizeof(success_msg));
+    }
+}
+
+// Command for showing how much of the PCB pool is in use
+void meminfo_command(const char *args)
+{
+    (void)args; // Mark the parameter as unused
+
+    struct pcb_pool_stats stats;
+    pcb_pool_get_stats(&stats);
+
+    printf("PCB pool: %u of %u in use, high water mark %u\r\n",
+           stats.in_use, stats.capacity, stats.high_water);
+    printf("Zombies awaiting reaper: %u\r\n", pcb_zombie_count());
+
+    // Frames given back by swapped-out stacks, less what holds their live data
+    struct stack_swap_stats swap;
+    stack_get_swap_stats(&swap);
+    printf("Swapped stacks: %u, %u bytes reclaimed (%u unmapped, %u buffered)\r\n",
+           swap.stacks, swap.released - swap.buffered, swap.released, swap.buffered);
+}
+
+// Command for listing the shared memory regions
+void showshm_command(const char *args)
+{
+    (void)args; // Mark the parameter as unused
+
+    struct shm_info info;
+    int found = 0;
+
+    for (unsigned int slot = 0; slot < SHM_MAX_REGIONS; slot++)
+    {
+        if (shm_get_info(slot, &info) != 0)
+        {
+            continue;
+        }
+        found = 1;
+
+        printf("%-15s %8u bytes at %p, attached %u\r\n",
+               info.name, info.size, info.addr, info.attached);
+    }
+
+    if (!found)
+    {
+        sys_req(WRITE, current_console(), "No shared memory regions\r\n", 26);
+    }
+}
+
+// Command for recording heap operations and dumping them to the console
+void alloctrace_command(const char *args)
+{
+    if (args != NULL && strcmp(args, "on") == 0)
+    {
+        sys_alloc_trace(1);
+        sys_req(WRITE, current_console(), "Allocation trace started\r\n", 26);
+    }
+    else if (args != NULL && strcmp(args, "off") == 0)
+    {
+        sys_alloc_trace(0);
+        sys_req(WRITE, current_console(), "Allocation trace stopped\r\n", 26);
+    }
+    else if (args != NULL && strcmp(args, "dump") == 0)
+    {
+        sys_alloc_trace_dump(current_console());
+    }
+    else
+    {
+        char err_msg[] = "Usage: alloctrace [on|off|dump]\r\n\0";
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
+    }
+}
+
+// Function to number a serial port for messages, COM1 being 1
+static int console_number(device dev)
+{
+    switch (dev)
+    {
+    case COM2:
+        return 2;
+    case COM3:
+        return 3;
+    case COM4:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+// Command for showing how efficiently this console's port is being fed
+void serialstats_command(const char *args)
+{
+    (void)args; // Mark the parameter as unused
+
+    struct serial_stats stats;
+    if (serial_get_stats(current_console(), &stats) != 0)
+    {
+        sys_req(WRITE, current_console(), "Port is not initialized\r\n", 25);
+        return;
+    }
+
+    // Shifted down so it fits printf's 32-bit conversions
+    printf("COM%d: %u bytes sent in %u refills of up to %u, stalled %u Kcycles\r\n",
+           console_number(current_console()),
+           stats.bytes_sent, stats.fifo_refills, stats.fifo_depth,
+           (unsigned int)(stats.stall_cycles >> 10));
+}
+
+// Command for showing or changing the line settings of a serial port,
+// e.g. 'serialcfg com1 115200 14 on'. Settings left out are kept.
+void serialcfg_command(const char *args)
+{
+    static const device ports[] = {COM1, COM2, COM3, COM4};
+    char usage[] = "Usage: serialcfg [com1-4] [baud] [fifo 1|4|8|14] [flow on|off]\r\n\0";
+
+    char *tokens[4];
+    int num_tokens = 0;
+    char *token = args != NULL ? strtok((char *)args, " \t\n") : NULL;
+    while (token != NULL && num_tokens < 4)
+    {
+        tokens[num_tokens++] = token;
+        token = strtok(NULL, " \t\n");
+    }
+
+    int port = console_number(current_console()) - 1;
+    if (num_tokens > 0)
+    {
+        if (strlen(tokens[0]) != 4 || (tokens[0][0] != 'c' && tokens[0][0] != 'C')
+            || tokens[0][3] < '1' || tokens[0][3] > '4')
+        {
+            sys_req(WRITE, current_console(), usage, sizeof(usage));
+            return;
+        }
+        port = tokens[0][3] - '1';
+    }
+
+    struct serial_config config;
+    if (serial_get_config(ports[port], &config) != 0)
+    {
+        printf("COM%d is not initialized\r\n", port + 1);
+        return;
+    }
+
+    if (num_tokens > 1)
+    {
+        config.baud = atoi(tokens[1]);
+        if (num_tokens > 2)
+        {
+            config.fifo_trigger = atoi(tokens[2]);
+        }
+        if (num_tokens > 3)
+        {
+            if (strcmp(tokens[3], "on") == 0)
+            {
+                config.flow_control = 1;
+            }
+            else if (strcmp(tokens[3], "off") == 0)
+            {
+                config.flow_control = 0;
+            }
+            else
+            {
+                sys_req(WRITE, current_console(), usage, sizeof(usage));
+                return;
+            }
+        }
+
+        // Output already queued is sent at the old settings first
+        if (serial_configure(ports[port], &config) != 0)
+        {
+            printf("Unsupported: baud must divide %d, FIFO trigger be 1, 4, 8 or 14\r\n",
+                   SERIAL_MAX_BAUD);
+            return;
+        }
+        serial_get_config(ports[port], &config);
+    }
+
+    printf("COM%d: %u baud 8N1, FIFO trigger %u, RTS/CTS %s\r\n", port + 1,
+           config.baud, config.fifo_trigger, config.flow_control ? "on" : "off");
+}
+
+// Function to parse a decimal or 0x-prefixed hexadecimal number
+static uint32_t parse_number(const char *s)
+{
+    if (s[0] != '0' || (s[1] != 'x' && s[1] != 'X'))
+    {
+        return (uint32_t)atoi(s);
+    }
+
+    uint32_t value = 0;
+    for (s += 2; *s; s++)
+    {
+        int digit;
+        if (*s >= '0' && *s <= '9')
+            digit = *s - '0';
+        else if (*s >= 'a' && *s <= 'f')
+            digit = *s - 'a' + 10;
+        else if (*s >= 'A' && *s <= 'F')
+            digit = *s - 'A' + 10;
+        else
+            break;
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+// Function to check that every page of [addr, addr + len) is mapped
+static int range_is_mapped(uint32_t addr, uint32_t len)
+{
+    if (len == 0)
+        return 1;
+    if (addr + len - 1 < addr)
+        return 0;
+    for (uint32_t page = addr & ~(PAGE_SIZE - 1); page <= addr + len - 1; page += PAGE_SIZE)
+    {
+        if (!vm_is_mapped(page))
+            return 0;
+        if (page + PAGE_SIZE == 0)
+            break;
+    }
+    return 1;
+}
+
+// Command for moving binary data to and from the host in checked frames.
+// The console's terminal must hand the port to tools/xfer while it runs.
+void xfer_command(const char *args)
+{
+    char usage[] = "Usage: xfer dump [addr] [len] | xfer trace | xfer recv [len]\r\n\0";
+
+    if (current_console() == CONSOLE)
+    {
+        sys_req(WRITE, current_console(), "Transfers need a serial console\r\n", 33);
+        return;
+    }
+
+    char *tokens[3];
+    int num_tokens = 0;
+    char *token = args != NULL ? strtok((char *)args, " \t\n") : NULL;
+    while (token != NULL && num_tokens < 3)
+    {
+        tokens[num_tokens++] = token;
+        token = strtok(NULL, " \t\n");
+    }
+
+    if (num_tokens == 1 && strcmp(tokens[0], "trace") == 0)
+    {
+        // Static, so repeated runs don't each take 16 KB of heap
+        static struct alloc_trace_entry entries[ALLOC_TRACE_SIZE];
+        unsigned int n = sys_alloc_trace_copy(entries, ALLOC_TRACE_SIZE);
+        printf("Sending %u trace entries of %u bytes\r\n", n, sizeof(*entries));
+        int result = xfer_send(current_console(), entries, n * sizeof(*entries));
+        printf(result == 0 ? "Transfer complete\r\n" : "Transfer failed\r\n");
+    }
+    else if (num_tokens == 3 && strcmp(tokens[0], "dump") == 0)
+    {
+        uint32_t addr = parse_number(tokens[1]);
+        uint32_t len = parse_number(tokens[2]);
+        if (!range_is_mapped(addr, len))
+        {
+            sys_req(WRITE, current_console(), "That range is not mapped\r\n", 26);
+            return;
+        }
+        printf("Sending %u bytes from %p\r\n", len, (void *)addr);
+        int result = xfer_send(current_console(), (const void *)addr, len);
+        printf(result == 0 ? "Transfer complete\r\n" : "Transfer failed\r\n");
+    }
+    else if (num_tokens == 2 && strcmp(tokens[0], "recv") == 0)
+    {
+        uint32_t len = parse_number(tokens[1]);
+
+        // Only into a buffer of our own; it stays allocated for the blob's user
+        void *buffer = len != 0 ? sys_alloc_mem(len) : NULL;
+        if (buffer == NULL)
+        {
+            sys_req(WRITE, current_console(), "Not enough memory\r\n", 19);
+            return;
+        }
+        printf("Receiving up to %u bytes at %p\r\n", len, buffer);
+
+        size_t received = 0;
+        if (xfer_recv(current_console(), buffer, len, &received) == 0)
+        {
+            printf("Received %u bytes at %p, CRC32 %x\r\n",
+                   received, buffer, xfer_crc32(0, buffer, received));
+        }
+        else
+        {
+            sys_free_mem(buffer);
+            printf("Transfer failed\r\n");
+        }
+    }
+    else
+    {
+        sys_req(WRITE, current_console(), usage, sizeof(usage));
+    }
+}
+
+// Command for reading and writing raw disk blocks through the block cache
+void disk_command(const char *args)
+{
+    char usage[] = "Usage: disk [info|stats|sync|read [block]|write [block] [text]]\r\n\0";
+
+    char *tokens[2];
+    int num_tokens = 0;
+    char *token = args != NULL ? strtok((char *)args, " \t\n") : NULL;
+    while (token != NULL && num_tokens < 2)
+    {
+        tokens[num_tokens++] = token;
+        token = num_tokens < 2 ? strtok(NULL, " \t\n") : NULL;
+    }
+
+    struct ata_info info;
+    if (ata_get_info(&info) != 0)
+    {
+        sys_req(WRITE, current_console(), "No disk on the primary IDE channel\r\n", 37);
+        return;
+    }
+
+    if (num_tokens == 0 || strcmp(tokens[0], "info") == 0)
+    {
+        printf("%s: %u sectors of %d bytes (%u MB)\r\n", info.model, info.sectors,
+               ATA_SECTOR_SIZE, info.sectors / (1024 * 1024 / ATA_SECTOR_SIZE));
+    }
+    else if (strcmp(tokens[0], "stats") == 0)
+    {
+        struct bcache_stats stats;
+        bcache_get_stats(&stats);
+        printf("%u hits, %u misses in %u disk reads; %u blocks read ahead, %u of them used\r\n",
+               stats.hits, stats.misses, stats.disk_reads, stats.readahead, stats.readahead_hits);
+        printf("%u blocks written back, %u dirty\r\n", stats.writebacks, stats.dirty);
+    }
+    else if (strcmp(tokens[0], "sync") == 0)
+    {
+        printf(bcache_sync() == 0 ? "Disk synced\r\n" : "Sync failed\r\n");
+    }
+    else if (strcmp(tokens[0], "read") == 0 && num_tokens == 2)
+    {
+        unsigned char block[BCACHE_BLOCK_SIZE];
+        uint32_t n = parse_number(tokens[1]);
+        if (bcache_read(n, block) != 0)
+        {
+            printf("Could not read block %u\r\n", n);
+            return;
+        }
+
+        // Sixteen bytes a line, in hex and then as text
+        for (int i = 0; i < BCACHE_BLOCK_SIZE; i += 16)
+        {
+            char text[17];
+            printf("%03x:", i);
+            for (int j = 0; j < 16; j++)
+            {
+                unsigned char c = block[i + j];
+                printf(" %02x", c);
+                text[j] = (c >= ' ' && c <= '~') ? c : '.';
+            }
+            text[16] = '\0';
+            printf("  %s\r\n", text);
+        }
+    }
+    else if (strcmp(tokens[0], "write") == 0 && num_tokens == 2)
+    {
+        // The text is the rest of the line, spaces and all, padded with zeros
+        unsigned char block[BCACHE_BLOCK_SIZE];
+        uint32_t n = parse_number(tokens[1]);
+        const char *text = strtok(NULL, "\n");
+        memset(block, 0, sizeof(block));
+        if (text != NULL)
+        {
+            size_t len = strlen(text);
+            memcpy(block, text, len < sizeof(block) ? len : sizeof(block));
+        }
+        if (bcache_write(n, block) != 0)
+        {
+            printf("Could not write block %u\r\n", n);
+            return;
+        }
+        printf("Block %u written to the cache; it reaches the disk on eviction or sync\r\n", n);
+    }
+    else
+    {
+        sys_req(WRITE, current_console(), usage, sizeof(usage));
+    }
+}
+
+// Function to turn a level name or number into a kernel log level, -1 if invalid
+static int parse_log_level(const char *s)
+{
+    for (int level = KLOG_ERR; level <= KLOG_DEBUG; level++)
+    {
+        const char *name = klog_level_name(level);
+        int match = 1;
+        for (int i = 0; name[i] || s[i]; i++)
+        {
+            // Case-insensitive, as the names are printed in capitals
+            char c = (s[i] >= 'a' && s[i] <= 'z') ? s[i] - 'a' + 'A' : s[i];
+            if (c != name[i])
+            {
+                match = 0;
+                break;
+            }
+        }
+        if (match || (s[0] == '0' + level && s[1] == '\0'))
+        {
+            return level;
+        }
+    }
+    return -1;
+}
+
+// Command for reading back the kernel log ring
+void dmesg_command(const char *args)
+{
+    int max_level = KLOG_DEBUG;
+    if (args != NULL && (max_level = parse_log_level(args)) < 0)
+    {
+        char err_msg[] = "Usage: dmesg [err|warn|info|debug]\r\n\0";
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
+        return;
+    }
+
+    // Timestamps are in units of 1024 TSC cycles, as on the console
+    uint32_t cursor = 0;
+    struct klog_entry entry;
+    while (klog_read(&cursor, &entry))
+    {
+        if (entry.level <= max_level)
+        {
+            printf("[%10u] %s %s: %s\r\n", (unsigned int)(entry.timestamp >> 10),
+                   klog_level_name(entry.level), entry.tag, entry.msg);
+        }
+    }
+}
+
+// Command for filtering what the kernel log prints on the console
+void loglevel_command(const char *args)
+{
+    if (args != NULL && klog_set_level(parse_log_level(args)) != 0)
+    {
+        char err_msg[] = "Usage: loglevel [err|warn|info|debug]\r\n\0";
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
+        return;
+    }
+    printf("Kernel log level: %s\r\n", klog_level_name(klog_get_level()));
+}
+
+// Command for turning stack swapping on suspend on or off
+void swapmode_command(const char *args)
+{
+    if (args != NULL && strcmp(args, "on") == 0)
+    {
+        swap_on_suspend = 1;
+    }
+    else if (args != NULL && strcmp(args, "off") == 0)
+    {
+        swap_on_suspend = 0;
+    }
+    else if (args != NULL)
+    {
+        char err_msg[] = "Usage: swapmode [on|off]\r\n\0";
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
+        return;
+    }
+
+    // Already-suspended processes keep whatever state they were parked in
+    if (swap_on_suspend)
+    {
+        sys_req(WRITE, current_console(), "Suspended stacks are swapped out\r\n", 34);
+    }
+    else
+    {
+        sys_req(WRITE, current_console(), "Suspended stacks stay resident\r\n", 32);
     }
 }
 
 void yield_command(const char *args){
     (void)args;
     char yield_msg[] = "Yielding R3...\r\n\0";
-    sys_req(WRITE, COM1, yield_msg, sizeof(yield_msg));
+    sys_req(WRITE, current_console(), yield_msg, sizeof(yield_msg));
     sys_req(IDLE);
     char done_msg[] = "Finished Yielding R3...\r\n\0";
-    sys_req(WRITE, COM1, done_msg, sizeof(done_msg));
+    sys_req(WRITE, current_console(), done_msg, sizeof(done_msg));
 }
 
 void loadR3_command(const char *args){
     (void)args;
     char load_msg[] = "Loading R3...\r\n\0";
-    sys_req(WRITE, COM1, load_msg, sizeof(load_msg));
+    sys_req(WRITE, current_console(), load_msg, sizeof(load_msg));
     load("P1", USER_APP, 3, proc1);
     load("P2", USER_APP, 3, proc2);
     load("P3", USER_APP, 3, proc3);
     load("P4", USER_APP, 3, proc4);
     load("P5", USER_APP, 3, proc5);
     char done_msg[] = "Finished Loading R3.\r\n\0";
-    sys_req(WRITE, COM1, done_msg, sizeof(done_msg));
+    sys_req(WRITE, current_console(), done_msg, sizeof(done_msg));
 }
 
 struct pcb *load(const char *name, int process_class, int priority, void (*proc)())
 {
-    struct pcb *new_pcb = allocate();   // allocates memory for the new pcb
-    
-    // Check if memory allocated successfully
-    if (new_pcb != NULL)
-    {
-        // Define attributes of new PCB
-        strcpy(new_pcb->process_name, name);
-        new_pcb->process_class = process_class;
-        new_pcb->process_priority = priority;
-        new_pcb->execution_state = READY;
-        new_pcb->dispatching_state = NOT_SUSPENDED;
+    return load_with_stack(name, process_class, priority, proc, STACK_DEFAULT_LIMIT);
+}
 
-        new_pcb->stack_ptr = (unsigned char *) new_pcb->stack + STACK_SIZE - 2 - sizeof(struct context);
+struct pcb *load_with_stack(const char *name, int process_class, int priority, void (*proc)(), size_t stack_limit)
+{
+    struct pcb *new_pcb = pcb_setup(name, process_class, priority, stack_limit);
 
+    // Check if a PCB was available
+    if (new_pcb != NULL)
+    {
         load_pcb(new_pcb, proc);
         pcb_insert(new_pcb);
     }
     return new_pcb;
 }
 
-unsigned char global_hours, global_minutes, global_seconds;
-const char* global_message;
+// Everything an alarm process needs, copied onto its own stack by spawn()
+struct alarm_args
+{
+    unsigned char hours, minutes, seconds;
+    char message[100];
+};
 
-void alarm_proc() 
+int alarm_proc(void *arg)
 {
+    const struct alarm_args *alarm = arg;
+
     unsigned char mpx_seconds = bcd_to_binary(read_rtc(RTC_SECONDS));
     unsigned char mpx_minutes = bcd_to_binary(read_rtc(RTC_MINUTES));
     unsigned char mpx_hours = bcd_to_binary(read_rtc(RTC_HOURS));
 
     int mpx_time = mpx_seconds + mpx_minutes * 60 + mpx_hours * 3600;
-    int alarm_time = global_seconds + global_minutes * 60 + global_hours * 3600;
-    global_hours = 0;
-    global_minutes = 0;
-    global_seconds = 0;
-
-    const char* message = global_message;
-
-    sys_req(WRITE, COM1, message, sizeof(message));
+    int alarm_time = alarm->seconds + alarm->minutes * 60 + alarm->hours * 3600;
 
     while (mpx_time < alarm_time)
     {
@@ -845,8 +1336,8 @@ void alarm_proc()
         mpx_time = mpx_seconds + mpx_minutes * 60 + mpx_hours * 3600;
     }
 
-    sys_req(WRITE, COM1, message, sizeof(message));
-    sys_req(EXIT);
+    printf("%s\r\n", alarm->message);
+    return 0;
 }
 
 void alarm_command(const char *args)
@@ -854,12 +1345,12 @@ void alarm_command(const char *args)
     if (args == NULL)
     {
         char err_msg[] = "Invalid format: 'alarm [time] [message]'\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
 
-    char *tokens[2];                              // array to store the name, class, and priority
+    char *tokens[2];                              // array to store the time and message
     char *token = strtok((char *)args, " \t\n"); // tokenize the first string on space, colon, tab, or newline
 
     int num_tokens = 0;
@@ -873,43 +1364,53 @@ void alarm_command(const char *args)
     if (num_tokens != 2)
     {
         char err_msg[] = "Please provide the time and message\r\n\0";
-        sys_req(WRITE, COM1, err_msg, sizeof(err_msg));
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
 
         return;
     }
 
     const char *time_str = tokens[0];
-    global_message = tokens[1];
+    struct alarm_args alarm;
 
-    sys_req(WRITE, COM1, global_message, sizeof(global_message));
+    alarm.hours = (time_str[0] - '0') * 10 + (time_str[1] - '0');
+    alarm.minutes = (time_str[3] - '0') * 10 + (time_str[4] - '0');
+    alarm.seconds = (time_str[6] - '0') * 10 + (time_str[7] - '0');
 
-    global_hours = (time_str[0] - '0') * 10 + (time_str[1] - '0');
-    global_minutes = (time_str[3] - '0') * 10 + (time_str[4] - '0');
-    global_seconds = (time_str[6] - '0') * 10 + (time_str[7] - '0');
-
-    if (global_hours > 23 || global_minutes > 59 || global_seconds > 59)
+    if (alarm.hours > 23 || alarm.minutes > 59 || alarm.seconds > 59)
     {
-        sys_req(WRITE, COM1, "Invalid time values.\r\n", 23);
+        sys_req(WRITE, current_console(), "Invalid time values.\r\n", 22);
         return;
     }
+    snprintf(alarm.message, sizeof(alarm.message), "%s", tokens[1]);
 
-    load("Alarm", USER_APP, 1, alarm_proc);
-    char done_msg[] = "Alarm set.\r\n\0";
-    sys_req(WRITE, COM1, done_msg, sizeof(done_msg));
+    // Each alarm gets its own name and its own copy of the arguments
+    static unsigned int alarms_set = 0;
+    char name[PCB_NAME_LEN + 1];
+    snprintf(name, sizeof(name), "Alarm%u", ++alarms_set % 1000);
 
+    if (spawn(name, USER_APP, 1, alarm_proc, &alarm, sizeof(alarm), SPAWN_DETACHED) < 0)
+    {
+        char err_msg[] = "Alarm could not be set.\r\n\0";
+        sys_req(WRITE, current_console(), err_msg, sizeof(err_msg));
+        return;
+    }
+    printf("Alarm set: %s\r\n", name);
 }
 
 void comhand(void)
 {
+    // Local, as every console runs its own comhand
+    int should_shutdown = 0;
+
     for (;;)
     {
         
-        sys_req(WRITE, COM1, "(path)===> $ ", 14);
+        sys_req(WRITE, current_console(), "(path)===> $ ", 14);
 
         char buf[100] = {0};
-        int nread = sys_req(READ, COM1, buf, sizeof(buf) - 1); // -1 to ensure space for null-terminator
-        sys_req(WRITE, COM1, "Your command : ", 16);
-        sys_req(WRITE, COM1, buf, nread);
+        int nread = sys_req(READ, current_console(), buf, sizeof(buf) - 1); // -1 to ensure space for null-terminator
+        sys_req(WRITE, current_console(), "Your command : ", 16);
+        sys_req(WRITE, current_console(), buf, nread);
         trim_input(buf);
 
         // Find the first space in buf
@@ -943,7 +1444,14 @@ void comhand(void)
         {
             if (strcmp(command, cmd->name) == 0)
             {
-                cmd->handler(args);
+                if (cmd->handler != NULL)
+                {
+                    cmd->handler(args);
+                }
+                else
+                {
+                    should_shutdown = shutdown_command(args);
+                }
                 found = 1;
                 break;
             }
@@ -951,7 +1459,7 @@ void comhand(void)
 
         if (!found)
         {
-            sys_req(WRITE, COM1, "Unvalid command. Use help command.\r\n", 40);
+            sys_req(WRITE, current_console(), "Unvalid command. Use help command.\r\n", 40);
         }
 
         // Check for shutdown command and confirmation
@@ -964,4 +1472,3 @@ void comhand(void)
         sys_req(IDLE);
     }
 }
-
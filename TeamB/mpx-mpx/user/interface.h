@@ -3,9 +3,14 @@
 #ifndef INTERFACE_H
 #define INTERFACE_H
 
+#include <stddef.h>
+
 // Function prototype for comhand
 void comhand(void);
 
 struct pcb *load(const char *name, int process_class, int priority, void (*proc)());
 
+// load() with a stack that may grow to stack_limit bytes instead of STACK_DEFAULT_LIMIT
+struct pcb *load_with_stack(const char *name, int process_class, int priority, void (*proc)(), size_t stack_limit);
+
 #endif  // INTERFACE_H
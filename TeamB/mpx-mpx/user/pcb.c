@@ -1,6 +1,8 @@
 #include <string.h>
 #include <pcb.h>
 #include <memory.h>
+#include <mpx/vm.h>
+#include <mpx/shm.h>
 #include <sys_req.h>
 #include <processes.h>
 
@@ -9,15 +11,81 @@ static struct queue *blocked_q = NULL;
 static struct queue *susp_ready_q = NULL;
 static struct queue *susp_blocked_q = NULL;
 
-// Function to allocate memory for a new PCB
+static struct pcb *pcb_pool = NULL;       // Hot descriptors, contiguous for queue walks
+static struct pcb_cold *pcb_cold_pool = NULL;  // Names and stacks, out of line
+static struct pcb *pcb_free_list = NULL;  // PCBs ready to hand out
+static struct pcb_pool_stats pool_stats = {0, 0, 0};
+static struct pcb *zombie_list = NULL;    // Exited PCBs waiting for the reaper
+static unsigned int zombie_count = 0;
+static int next_pid = 1;
+
+// Function to preallocate a pool of PCBs, returns 0 on success
+int pcb_pool_init(unsigned int capacity)
+{
+    if (pcb_pool != NULL || capacity == 0 || capacity > STACK_SLOTS)
+    {
+        return -1; // Error: already initialized, or no stack slot for every PCB
+    }
+
+    // PCBs come from the kernel heap, not the arena of whichever process is running
+    pcb_pool = (struct pcb *)kmalloc(capacity * sizeof(struct pcb), 0, NULL);
+    pcb_cold_pool = (struct pcb_cold *)kmalloc(capacity * sizeof(struct pcb_cold), 0, NULL);
+    if (pcb_pool == NULL || pcb_cold_pool == NULL)
+    {
+        return -1;
+    }
+
+    // Pair each descriptor with its cold data and thread it onto the free list
+    for (unsigned int i = 0; i < capacity; i++)
+    {
+        pcb_pool[i].cold = &pcb_cold_pool[i];
+        pcb_cold_pool[i].stack.mapped = 0;
+        pcb_cold_pool[i].stack.swapped = NULL;
+        pcb_pool[i].next = (i + 1 < capacity) ? &pcb_pool[i + 1] : NULL;
+    }
+    pcb_free_list = pcb_pool;
+    pool_stats.capacity = capacity;
+
+    return 0;
+}
+
+// Function to read the PCB pool usage counters
+void pcb_pool_get_stats(struct pcb_pool_stats *stats)
+{
+    *stats = pool_stats;
+}
+
+// Function to take a PCB from the pool, NULL if the pool is exhausted
 struct pcb *allocate(void)
 {
-    struct pcb *new_pcb = (struct pcb *)sys_alloc_mem(sizeof(struct pcb));  // allocates memory for the pcb struct
-    
+    if (pcb_pool == NULL)
+    {
+        pcb_pool_init(PCB_POOL_CAPACITY);
+    }
+
+    struct pcb *new_pcb = pcb_free_list;
+    if (new_pcb == NULL)
+    {
+        return NULL; // Error: pool exhausted
+    }
+    pcb_free_list = new_pcb->next;
+
+    // Only the links and the arena need resetting; the stack is overwritten by load_pcb()
+    new_pcb->next = NULL;
+    arena_init(&new_pcb->cold->arena);
+    new_pcb->cold->shm_attached = 0;
+    new_pcb->cold->out.len = 0;
+    new_pcb->cold->io.queued = 0;
+
+    pool_stats.in_use++;
+    if (pool_stats.in_use > pool_stats.high_water)
+    {
+        pool_stats.high_water = pool_stats.in_use;
+    }
     return new_pcb;
 }
 
-// Function to free memory associated with a PCB
+// Function to return a PCB and everything it allocated to the pool
 int pcb_free(struct pcb *pcb)
 {
     if (pcb == NULL)
@@ -25,44 +93,209 @@ int pcb_free(struct pcb *pcb)
         return -1; // Error: NULL pointer
     }
 
-    // Free the memory for the stack pointer
-    if (pcb->stack_ptr != NULL)
+    // Return everything the process allocated in one step
+    arena_release(&pcb->cold->arena);
+    stack_free(&pcb->cold->stack);
+    shm_release(&pcb->cold->shm_attached);
+
+    pcb->next = pcb_free_list;
+    pcb_free_list = pcb;
+    pool_stats.in_use--;
+
+    return 0; // Success
+}
+
+// Function to turn a PCB into a zombie; constant time, frees nothing
+void pcb_exit(struct pcb *pcb, int status)
+{
+    // Shared regions are let go straight away, so the last user frees them
+    shm_release(&pcb->cold->shm_attached);
+
+    // The device must not finish a request into a buffer that is going away
+    io_cancel(pcb);
+
+    // A process deleted while it waited leaves nothing for its child to wake
+    if (pcb->cold->waiting_on != NULL)
     {
-        sys_free_mem((void *)pcb->stack_ptr);
+        pcb->cold->waiting_on->cold->waiter = NULL;
+        pcb->cold->waiting_on = NULL;
     }
 
-    // Free the memory for the PCB itself
-    sys_free_mem(pcb);
+    // Hand the status straight to a parent blocked in WAIT
+    struct pcb *waiter = pcb->cold->waiter;
+    if (waiter != NULL)
+    {
+        pcb->cold->waiter = NULL;
+        waiter->cold->waiting_on = NULL;
+        waiter->cold->wait_status = status;
+        pcb->cold->parent_pid = 0;  // Collected, so the reaper may free it
 
-    return 0; // Success
+        if (waiter->execution_state == BLOCKED && pcb_remove(waiter) == 0)
+        {
+            waiter->execution_state = READY;
+            pcb_insert(waiter);
+        }
+    }
+
+    pcb->execution_state = ZOMBIE;
+    pcb->cold->exit_status = status;
+    pcb->next = zombie_list;
+    zombie_list = pcb;
+    zombie_count++;
+}
+
+// Function to free every zombie except running, whose stack is in use
+unsigned int pcb_reap(const struct pcb *running)
+{
+    unsigned int reaped = 0;
+    struct pcb **link = &zombie_list;
+
+    while (*link != NULL)
+    {
+        struct pcb *zombie = *link;
+        if (zombie == running)
+        {
+            link = &zombie->next;  // Leave it for the next batch
+            continue;
+        }
+
+        // Keep the status until the parent waits for it or exits itself
+        if (zombie->cold->parent_pid != 0)
+        {
+            struct pcb *parent = pcb_find_pid(zombie->cold->parent_pid);
+            if (parent != NULL && parent->execution_state != ZOMBIE)
+            {
+                link = &zombie->next;
+                continue;
+            }
+        }
+        *link = zombie->next;
+        pcb_free(zombie);
+        reaped++;
+    }
+
+    zombie_count -= reaped;
+    return reaped;
+}
+
+// Function to count the zombies waiting to be reaped
+unsigned int pcb_zombie_count(void)
+{
+    return zombie_count;
+}
+
+// Function to search one queue by pid
+static struct pcb *find_pid_in(struct pcb *current, int pid)
+{
+    while (current != NULL && current->cold->pid != pid)
+    {
+        current = current->next;
+    }
+    return current;
+}
+
+// Function to find a PCB by pid, zombies included
+struct pcb *pcb_find_pid(int pid)
+{
+    struct queue *queues[] = {ready_q, blocked_q, susp_ready_q, susp_blocked_q};
+    struct pcb *found = NULL;
+
+    if (current_process != NULL && current_process->cold->pid == pid)
+    {
+        return current_process;
+    }
+    for (unsigned int i = 0; i < sizeof(queues) / sizeof(queues[0]) && found == NULL; i++)
+    {
+        if (queues[i] != NULL)
+        {
+            found = find_pid_in(queues[i]->front, pid);
+        }
+    }
+    return found != NULL ? found : find_pid_in(zombie_list, pid);
+}
+
+// Function for WAIT: collects an exited child's status, or says to block
+int pcb_wait(struct pcb *parent, int pid)
+{
+    struct pcb *child = pcb_find_pid(pid);
+    if (child == NULL || child == parent || child->cold->parent_pid != parent->cold->pid)
+    {
+        return -1; // Error: not a child, already collected, or detached
+    }
+
+    if (child->execution_state == ZOMBIE)
+    {
+        parent->cold->wait_status = child->cold->exit_status;
+        child->cold->parent_pid = 0;  // Collected, so the reaper may free it
+        return 0;
+    }
+
+    // Drop any wait left behind by an unblockpcb, then wait for this child
+    if (parent->cold->waiting_on != NULL)
+    {
+        parent->cold->waiting_on->cold->waiter = NULL;
+    }
+    parent->cold->waiting_on = child;
+    child->cold->waiter = parent;
+    return 1;
 }
 
 // Function to allocate and initialize a new PCB
-struct pcb *pcb_setup(const char *name, int process_class, int priority)
+struct pcb *pcb_setup(const char *name, int process_class, int priority, size_t stack_limit)
 {
     struct pcb *new_pcb = allocate();   // allocates memory for the new pcb
-    
+
+    // Each pool entry owns the stack slot with the same index
+    if (new_pcb != NULL && stack_alloc(&new_pcb->cold->stack, new_pcb - pcb_pool, stack_limit) != 0)
+    {
+        pcb_free(new_pcb);
+        new_pcb = NULL;
+    }
+
     // Check if memory allocated successfully
     if (new_pcb != NULL)
     {
-        // Define attributes of new PCB
-        strcpy(new_pcb->process_name, name);
+        // Define attributes of new PCB, truncating over-long names
+        size_t len = strlen(name);
+        if (len > PCB_NAME_LEN)
+        {
+            len = PCB_NAME_LEN;
+        }
+        memcpy(new_pcb->cold->process_name, name, len);
+        new_pcb->cold->process_name[len] = '\0';
+        new_pcb->name_hash = pcb_name_hash(new_pcb->cold->process_name);
         new_pcb->process_class = process_class;
         new_pcb->process_priority = priority;
         new_pcb->execution_state = READY;
         new_pcb->dispatching_state = NOT_SUSPENDED;
-
-        new_pcb->stack_ptr = (unsigned char *) new_pcb->stack + STACK_SIZE - 2 - sizeof(struct context);
-
-        pcb_insert(new_pcb);
+        new_pcb->cold->pid = next_pid++;
+        new_pcb->cold->parent_pid = 0;
+        new_pcb->cold->waiter = NULL;
+        new_pcb->cold->waiting_on = NULL;
+        new_pcb->cold->console = current_console();  // Inherited from the creator
+
+        // The initial context sits at the top of the first stack page
+        new_pcb->stack_ptr = (unsigned char *) new_pcb->cold->stack.top - sizeof(uint32_t) - sizeof(struct context);
     }
     return new_pcb;
 }
 
+// Function to hash a process name for pcb_find() (32-bit FNV-1a)
+uint32_t pcb_name_hash(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < PCB_NAME_LEN && name[i] != '\0'; i++)
+    {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
 // Function to find a PCB by name
 struct pcb *pcb_find(const char *name)
 {
     struct pcb *current;
+    uint32_t hash = pcb_name_hash(name);  // Compare hashes so only likely matches touch cold data
     // Search Ready Queue if it exists
     if (ready_q != NULL)
     {
@@ -72,7 +305,7 @@ struct pcb *pcb_find(const char *name)
         while (current != NULL)
         {   
             // Check if the names match and return the current PCB if they do
-            if (strcmp(current->process_name, name) == 0)
+            if (current->name_hash == hash && strcmp(current->cold->process_name, name) == 0)
             {
                 return current;
             }
@@ -88,7 +321,7 @@ struct pcb *pcb_find(const char *name)
         while (current != NULL)
         {   
             // Check if the names match and return the current PCB if they do
-            if (strcmp(current->process_name, name) == 0)
+            if (current->name_hash == hash && strcmp(current->cold->process_name, name) == 0)
             {
                 return current;
             }
@@ -104,7 +337,7 @@ struct pcb *pcb_find(const char *name)
         while (current != NULL)
         {   
             // Check if the names match and return the current PCB if they do
-            if (strcmp(current->process_name, name) == 0)
+            if (current->name_hash == hash && strcmp(current->cold->process_name, name) == 0)
             {
                 return current;
             }
@@ -120,7 +353,7 @@ struct pcb *pcb_find(const char *name)
         while (current != NULL)
         {   
             // Check if the names match and return the current PCB if they do
-            if (strcmp(current->process_name, name) == 0)
+            if (current->name_hash == hash && strcmp(current->cold->process_name, name) == 0)
             {
                 return current;
             }
@@ -148,7 +381,7 @@ void pcb_insert(struct pcb *pcb)
             // Creates the Ready Queue if it doesn't already exist
             if (ready_q == NULL) 
             {
-                ready_q = (struct queue *)sys_alloc_mem(sizeof(struct queue));
+                ready_q = (struct queue *)kmalloc(sizeof(struct queue), 0, NULL);
                 ready_q->front = pcb;
                 pcb->next = NULL;
                 return;
@@ -197,7 +430,7 @@ void pcb_insert(struct pcb *pcb)
             // Creates the Blocked Queue if it doesn't already exist
             if (blocked_q == NULL) 
             {
-                blocked_q = (struct queue *)sys_alloc_mem(sizeof(struct queue));
+                blocked_q = (struct queue *)kmalloc(sizeof(struct queue), 0, NULL);
                 blocked_q->front = pcb;
                 pcb->next = NULL;
                 return;
@@ -227,7 +460,7 @@ void pcb_insert(struct pcb *pcb)
             // Creates the Suspended Ready Queue if it doesn't already exist
             if (susp_ready_q == NULL) 
             {
-                susp_ready_q = (struct queue *)sys_alloc_mem(sizeof(struct queue));
+                susp_ready_q = (struct queue *)kmalloc(sizeof(struct queue), 0, NULL);
                 susp_ready_q->front = pcb;
                 pcb->next = NULL;
                 return;
@@ -276,7 +509,7 @@ void pcb_insert(struct pcb *pcb)
             // Creates the Suspended Blocked Queue if it doesn't already exist
             if (susp_blocked_q == NULL) 
             {
-                susp_blocked_q = (struct queue *)sys_alloc_mem(sizeof(struct queue));
+                susp_blocked_q = (struct queue *)kmalloc(sizeof(struct queue), 0, NULL);
                 susp_blocked_q->front = pcb;
                 pcb->next = NULL;
                 return;
@@ -459,6 +692,12 @@ int pcb_set_priority(const char *name, int new_priority)
     return 0; // Success
 }
 
+// Function to get the console of the running process, COM1 if none is running
+device current_console(void)
+{
+    return current_process != NULL ? current_process->cold->console : COM1;
+}
+
 // getters to access the queues from the interface.c file 
 struct queue* get_ready_q() {
     return ready_q;
@@ -487,7 +726,7 @@ void load_pcb(struct pcb *p, void (*proc)()) {
  cp->gs = (uint32_t) 0x10;
  cp->ss = (uint32_t) 0x10;
 
- cp->ebp = (uint32_t) p->stack;
+ cp->ebp = (uint32_t) p->cold->stack.top;
  cp->esp = (uint32_t) p->stack_ptr;
 
  cp->eip = (uint32_t) proc;
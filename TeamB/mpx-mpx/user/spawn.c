@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <string.h>
+#include <pcb.h>
+#include <spawn.h>
+#include <sys_req.h>
+
+// First code a spawned process runs; fn and arg sit above it on the new stack
+static void spawn_entry(int (*fn)(void *), void *arg)
+{
+    process_exit(fn(arg));
+}
+
+// Function to create a ready process that runs fn(arg)
+int spawn(const char *name, int process_class, int priority,
+          int (*fn)(void *), const void *arg, size_t arg_size, int flags)
+{
+    if (fn == NULL || arg_size > SPAWN_ARG_MAX)
+    {
+        return -1; // Error: nothing to run, or the argument won't fit the first stack page
+    }
+
+    struct pcb *child = pcb_setup(name, process_class, priority, STACK_DEFAULT_LIMIT);
+    if (child == NULL)
+    {
+        return -1; // Error: no PCB or stack available
+    }
+
+    // Copy the argument to the top of the stack, so it outlives the caller's copy
+    uint32_t top = child->cold->stack.top;
+    void *child_arg = (void *)arg;
+    if (arg_size > 0)
+    {
+        top -= (arg_size + 3) & ~(size_t)3;
+        memcpy((void *)top, arg, arg_size);
+        child_arg = (void *)top;
+    }
+
+    // Below it, the frame spawn_entry() is entered with: return address, fn, arg
+    uint32_t *frame = (uint32_t *)top - 3;
+    frame[0] = 0; // spawn_entry() never returns
+    frame[1] = (uint32_t)fn;
+    frame[2] = (uint32_t)child_arg;
+
+    child->stack_ptr = (unsigned char *)frame - sizeof(struct context);
+    load_pcb(child, (void (*)(void))spawn_entry);
+
+    // Detached children, and those spawned outside a process, have no one to wait for them
+    if (!(flags & SPAWN_DETACHED) && current_process != NULL)
+    {
+        child->cold->parent_pid = current_process->cold->pid;
+    }
+
+    pcb_insert(child);
+    return child->cold->pid;
+}
+
+// Function to block until a child exits and collect its status
+int wait_pid(int pid, int *status)
+{
+    int ret;
+    __asm__ volatile("int $0x60" : "=a"(ret) : "a"(WAIT), "b"(pid) : "memory");
+
+    // Still linked to the child means unblockpcb ended the wait early
+    if (ret == 0 && current_process->cold->waiting_on != NULL)
+    {
+        current_process->cold->waiting_on->cold->waiter = NULL;
+        current_process->cold->waiting_on = NULL;
+        ret = -1;
+    }
+
+    if (ret == 0 && status != NULL)
+    {
+        *status = current_process->cold->wait_status;
+    }
+    return ret;
+}
+
+// Function to end the running process with an exit status
+void process_exit(int status)
+{
+    for (;;)
+    {
+        __asm__ volatile("int $0x60" : : "a"(EXIT), "b"(status) : "memory");
+    }
+}